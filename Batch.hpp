@@ -0,0 +1,172 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "Map.hpp"
+
+/**
+* Un mapa a generar en un lote (ver BasicMapBatch::generate()): el mismo que Map(detail, seed) y generate(roughness)
+*/
+struct TrabajoMapa {
+	int seed;
+	float roughness;
+	int detail;
+};
+
+/**
+* Generador de muchos mapas de una vez. Los trabajos se reparten entre varios hilos (cada mapa lo genera entero un solo
+* hilo, con generate(roughness), asi que sale igual que generandolo aparte), y cada mapa terminado se le pasa a un
+* destino (ver DestinoMapas), que hace con el lo que quiera (guardarlo, analizarlo...) antes de que se descarte.
+*
+* Las matrices de alturas no se reservan una por mapa: salen de una bolsa de matrices libres, y cuando el destino ha
+* terminado con un mapa, su matriz vuelve a la bolsa para el siguiente. En la bolsa se quedan como mucho maxLibres
+* matrices (las que sobran se liberan), asi que la memoria no crece con el numero de mapas: como mucho hay
+* threads + maxLibres matrices a la vez, las del mapa mas grande del lote. Las matrices se reservan con Alloc, igual que
+* las de los mapas (ver Storage.hpp).
+*/
+template <class Sample = float, class Rng = Xoshiro128Plus, class Alloc = AsignadorAlineado<Sample> >
+class BasicMapBatch {
+public:
+
+	/**
+	* Recibe los mapas de un lote segun se van generando
+	*/
+	class DestinoMapas {
+	public:
+		virtual ~DestinoMapas(){}
+
+		/**
+		* Se llama con cada mapa recien generado: el trabajo numero 'indice' del lote. El mapa (y su matriz) solo existe
+		* hasta que termina la llamada; si hace falta despues hay que copiarlo.
+		* Se llama desde los hilos del lote, varios a la vez y sin seguir el orden de los trabajos: si el destino guarda
+		* algo compartido, tiene que protegerlo el
+		*/
+		virtual void mapaGenerado(size_t indice, const TrabajoMapa &trabajo, BasicMap<Sample, Rng, Alloc> &mapa) = 0;
+	};
+
+private:
+	int threads;
+	size_t maxLibres;
+	Alloc alloc;
+
+	/*
+	* Bolsa de matrices libres, y cuantas se han reservado en total (para saber si de verdad se reutilizan)
+	*/
+	std::vector<std::vector<Sample, Alloc> > libres;
+	std::mutex cerrojo;
+	long long reservadas;
+
+	/**
+	* Saca de la bolsa una matriz de al menos n muestras (sin volver a reservar, si hay alguna con capacidad), o reserva
+	* una nueva si no hay ninguna
+	*/
+	void saca(size_t n, std::vector<Sample, Alloc> &alturas){
+		{
+			std::lock_guard<std::mutex> bloqueo(cerrojo);
+			for (size_t i = libres.size(); i-- > 0; ){
+				if (libres[i].capacity() >= n){
+					alturas.swap(libres[i]);
+					libres.erase(libres.begin() + i);
+					break;
+				}
+			}
+			if (alturas.capacity() < n) ++reservadas;
+		}
+		alturas.resize(n);
+	}
+
+	/**
+	* Devuelve una matriz a la bolsa. Si la bolsa esta llena, se queda la mas grande de las dos y la otra se libera
+	*/
+	void devuelve(std::vector<Sample, Alloc> &alturas){
+		std::lock_guard<std::mutex> bloqueo(cerrojo);
+		if (libres.size() < maxLibres){
+			libres.push_back(std::vector<Sample, Alloc>(this->alloc));
+			libres.back().swap(alturas);
+			return;
+		}
+		size_t menor = 0;
+		for (size_t i = 1; i < libres.size(); ++i){
+			if (libres[i].capacity() < libres[menor].capacity()) menor = i;
+		}
+		if (!libres.empty() && libres[menor].capacity() < alturas.capacity()) libres[menor].swap(alturas);
+		std::vector<Sample, Alloc>(this->alloc).swap(alturas);
+	}
+
+public:
+
+	/**
+	* Crea un generador de lotes que usa 'threads' hilos (<= 0 para usar todos los nucleos) y guarda como mucho
+	* maxLibres matrices libres entre mapa y mapa (< 0 para guardar tantas como hilos), reservadas con alloc.
+	* Con un Rng que comparte su estado entre mapas (RandGlobal) los mapas se generan de uno en uno, en orden
+	*/
+	BasicMapBatch(int threads = 0, int maxLibres = -1, const Alloc &alloc = Alloc()) : alloc(alloc){
+		if (threads <= 0) threads = std::thread::hardware_concurrency();
+		if (threads < 1 || !EstadoPropio<Rng>::valor) threads = 1;
+		this->threads = threads;
+		this->maxLibres = (maxLibres < 0) ? (size_t)threads : (size_t)maxLibres;
+		this->reservadas = 0;
+	}
+
+	/**
+	* Genera todos los trabajos, repartidos entre los hilos, y le pasa cada mapa a destino segun se termina.
+	* Vuelve cuando se han generado (y entregado) todos
+	*/
+	void generate(const std::vector<TrabajoMapa> &trabajos, DestinoMapas &destino){
+		std::atomic<size_t> siguiente(0);
+		int hilos = ((size_t)threads < trabajos.size()) ? threads : (int)trabajos.size();
+		auto trabajo = [&](){
+			std::vector<Sample, Alloc> alturas(this->alloc);
+			for (size_t i = siguiente++; i < trabajos.size(); i = siguiente++){
+				const TrabajoMapa &t = trabajos[i];
+				size_t size = ((size_t)1 << t.detail) + 1;
+				saca(size * size, alturas);
+				BasicMap<Sample, Rng, Alloc> mapa(t.detail, t.seed, &alturas[0]);
+				mapa.setRenderSink(NULL);
+				mapa.generate(t.roughness);
+				destino.mapaGenerado(i, t, mapa);
+				devuelve(alturas);
+			}
+		};
+		std::vector<std::thread> lanzados;
+		for (int i = 1; i < hilos; ++i){
+			lanzados.push_back(std::thread(trabajo));
+		}
+		trabajo();
+		for (size_t i = 0; i < lanzados.size(); ++i){
+			lanzados[i].join();
+		}
+	}
+
+	int getThreads() const {
+		return threads;
+	}
+
+	/**
+	* Matrices de alturas reservadas desde que se creo el generador (si se reutilizan bien, no pasa de threads + maxLibres)
+	*/
+	long long getReservadas(){
+		std::lock_guard<std::mutex> bloqueo(cerrojo);
+		return reservadas;
+	}
+
+	/**
+	* Matrices que hay ahora mismo en la bolsa
+	*/
+	size_t getLibres(){
+		std::lock_guard<std::mutex> bloqueo(cerrojo);
+		return libres.size();
+	}
+
+	/**
+	* Libera todas las matrices de la bolsa
+	*/
+	void vaciaBolsa(){
+		std::lock_guard<std::mutex> bloqueo(cerrojo);
+		libres.clear();
+	}
+};
+
+typedef BasicMapBatch<> MapBatch;
@@ -0,0 +1,342 @@
+/*
+* Benchmark de MapGen2: mide la generacion (de uno en uno y por lotes), la edicion de sectores y todos los
+* representadores, y saca los resultados en JSON por la salida estandar (para poder guardarlos y comparar versiones).
+*
+*	Benchmark [detalleMin] [detalleMax] [detalleRepresentacion] [hilos]
+*
+* Por defecto genera de detalle 5 a 14, representa con detalle 9 y usa todos los nucleos para generate(r, hilos) y para
+* representar (las representaciones completas se miden tambien con un solo hilo).
+* Ojo: un mapa de detalle 14 ocupa 1 GB en float.
+* No necesita ventana: los representadores vuelcan a un RenderSink que solo cuenta pixeles.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include "Map.hpp"
+#include "Batch.hpp"
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+/**
+* Destino de representacion que no pinta nada: solo lee el rectangulo presentado (para que el trabajo de representar
+* no se pueda dar por inutil) y cuenta sus pixeles
+*/
+class NullSink : public RenderSink {
+public:
+	long long pixeles;
+	uint32_t suma;
+
+	NullSink(){
+		pixeles = 0;
+		suma = 0;
+	}
+
+	void presenta(const FrameBuffer &fb, int x, int y, int ancho, int alto){
+		for (int j = y; j < y + alto; ++j){
+			const uint32_t *fila = fb.getPixeles() + (size_t)j * fb.getAncho();
+			for (int i = x; i < x + ancho; ++i){
+				suma += fila[i];
+			}
+		}
+		pixeles += (long long)ancho * alto;
+	}
+};
+
+/**
+* Destino de lotes que no guarda nada: solo lee una altura de cada mapa generado y los cuenta
+*/
+class NullDestino : public MapBatch::DestinoMapas {
+public:
+	std::atomic<long long> mapas;
+	std::atomic<long long> suma;
+
+	NullDestino() : mapas(0), suma(0){
+	}
+
+	void mapaGenerado(size_t, const TrabajoMapa&, Map &mapa){
+		suma += (long long)mapa.getHeights()[mapa.getSize() / 2];
+		++mapas;
+	}
+};
+
+/**
+* Pico de memoria residente del proceso hasta ahora, en KB
+*/
+static long long picoMemoriaKB(){
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return -1;
+	return (long long)(pmc.PeakWorkingSetSize / 1024);
+#else
+	struct rusage uso;
+	if (getrusage(RUSAGE_SELF, &uso) != 0) return -1;
+#ifdef __APPLE__
+	return (long long)uso.ru_maxrss / 1024;	// en macOS viene en bytes
+#else
+	return (long long)uso.ru_maxrss;
+#endif
+#endif
+}
+
+static double ahora(){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+* Repite trabajo() hasta llevar al menos 'minimo' segundos (y como minimo una vez), y devuelve el tiempo de la vuelta
+* mas rapida, que es el menos afectado por el resto del sistema
+*/
+template <class Trabajo>
+static double mide(const Trabajo &trabajo, double minimo = 0.3){
+	double mejor = 1e30;
+	double inicio = ahora();
+	do {
+		double t0 = ahora();
+		trabajo();
+		double t = ahora() - t0;
+		if (t < mejor) mejor = t;
+	} while (ahora() - inicio < minimo);
+	return mejor;
+}
+
+static bool primero = true;
+
+/**
+* Escribe un resultado (un objeto del array JSON abierto) con las medidas comunes
+*/
+static void resultado(const char *campos, double casillas, double segundos){
+	printf("%s\n\t\t{%s, \"cells\": %.0f, \"seconds\": %.9f, \"cells_per_s\": %.1f, \"ns_per_cell\": %.4f, \"peak_rss_kb\": %lld}",
+		primero ? "" : ",", campos, casillas, segundos, casillas / segundos, segundos * 1e9 / casillas, picoMemoriaKB());
+	primero = false;
+	fflush(stdout);
+}
+
+static void abreSeccion(const char *nombre){
+	printf("\t\"%s\": [", nombre);
+	primero = true;
+}
+
+static void cierraSeccion(){
+	printf("\n\t],\n");
+}
+
+int main(int argc, char **argv){
+	int detalleMin = (argc > 1) ? atoi(argv[1]) : 5;
+	int detalleMax = (argc > 2) ? atoi(argv[2]) : 14;
+	int detalleRepr = (argc > 3) ? atoi(argv[3]) : 9;
+	int hilos = (argc > 4) ? atoi(argv[4]) : (int)std::thread::hardware_concurrency();
+	if (hilos < 1) hilos = 1;
+	const float roughness = 0.7f;
+	char campos[256];
+
+	printf("{\n\t\"benchmark\": \"MapGen2\",\n\t\"threads\": %d,\n\t\"roughness\": %g,\n", hilos, roughness);
+
+	// GENERACION: generate(r) con el generador del mapa, y generate(r, hilos) con offsets por hash
+	abreSeccion("generate");
+	for (int detalle = detalleMin; detalle <= detalleMax; ++detalle){
+		Map m(detalle, 1234);
+		m.setRenderSink(NULL);
+		double casillas = (double)m.getSize() * m.getSize();
+		double t = mide([&](){ m.generate(roughness); });
+		sprintf(campos, "\"detail\": %d, \"mode\": \"rng\", \"threads\": 1", detalle);
+		resultado(campos, casillas, t);
+		t = mide([&](){ m.generate(roughness, 1); });
+		sprintf(campos, "\"detail\": %d, \"mode\": \"hash\", \"threads\": 1", detalle);
+		resultado(campos, casillas, t);
+		if (hilos > 1){
+			t = mide([&](){ m.generate(roughness, hilos); });
+			sprintf(campos, "\"detail\": %d, \"mode\": \"hash\", \"threads\": %d", detalle, hilos);
+			resultado(campos, casillas, t);
+		}
+	}
+	cierraSeccion();
+
+	// CONSULTAS SUELTAS: heightAt() de 4096 casillas al azar de un mapa de detalle detalleMax, sin generarlo
+	abreSeccion("heightAt");
+	{
+		const int n = 4096;
+		std::vector<int> xs(n), ys(n);
+		std::vector<float> alturas(n);
+		int lado = (1 << detalleMax) + 1;
+		for (int i = 0; i < n; ++i){
+			xs[i] = (int)(((long long)i * 7919) % lado);
+			ys[i] = (int)(((long long)i * 104729) % lado);
+		}
+		double t = mide([&](){
+			for (int i = 0; i < n; ++i){
+				alturas[i] = Map::heightAt(1234, roughness, detalleMax, xs[i], ys[i]);
+			}
+		});
+		sprintf(campos, "\"detail\": %d, \"mode\": \"single\"", detalleMax);
+		resultado(campos, n, t);
+		t = mide([&](){ Map::heightAt(1234, roughness, detalleMax, &xs[0], &ys[0], n, &alturas[0]); });
+		sprintf(campos, "\"detail\": %d, \"mode\": \"batch\"", detalleMax);
+		resultado(campos, n, t);
+	}
+	cierraSeccion();
+
+	// EDICION: modificaSector() con sectores de lado 2^lado + 1, repartidos por un mapa de detalle 10
+	abreSeccion("modificaSector");
+	{
+		Map m(10, 1234);
+		m.setRenderSink(NULL);
+		m.generate(roughness);
+		for (int lado = 2; lado <= 8; ++lado){
+			int tam = (1 << lado) + 1;
+			int huecos = m.getSize() - tam - 1;
+			long long n = 0;
+			double t = mide([&](){
+				int origX = (int)((n * 7919) % huecos);
+				int origY = (int)((n * 104729) % huecos);
+				m.modificaSector(origX, origY, lado, 0.5f, 100);
+				++n;
+			});
+			sprintf(campos, "\"detail\": 10, \"sector\": %d", tam);
+			resultado(campos, (double)tam * tam, t);
+		}
+	}
+	cierraSeccion();
+
+	// EDICION EN LOTE: modificaSectores() con 1024 sectores de lado 17 repartidos por un mapa de detalle 10
+	abreSeccion("modificaSectores");
+	{
+		Map m(10, 1234);
+		m.setRenderSink(NULL);
+		m.generate(roughness);
+		std::vector<EdicionSector> ediciones(1024);
+		int huecos = m.getSize() - 17 - 1;
+		for (size_t n = 0; n < ediciones.size(); ++n){
+			ediciones[n].origX = (int)((n * 7919) % huecos);
+			ediciones[n].origY = (int)((n * 104729) % huecos);
+			ediciones[n].lado = 4;
+			ediciones[n].roughness = 0.5f;
+			ediciones[n].centralHeight = 100;
+		}
+		double casillas = (double)ediciones.size() * 17 * 17;
+		double t = mide([&](){ m.modificaSectores(ediciones, 1); });
+		resultado("\"detail\": 10, \"sector\": 17, \"edits\": 1024, \"threads\": 1", casillas, t);
+		if (hilos > 1){
+			t = mide([&](){ m.modificaSectores(ediciones, hilos); });
+			sprintf(campos, "\"detail\": 10, \"sector\": 17, \"edits\": 1024, \"threads\": %d", hilos);
+			resultado(campos, casillas, t);
+		}
+	}
+	cierraSeccion();
+
+	// LOTES: MapBatch::generate() con 256 mapas de detalle 8, cada uno con su semilla
+	abreSeccion("batch");
+	{
+		std::vector<TrabajoMapa> trabajos(256);
+		for (size_t n = 0; n < trabajos.size(); ++n){
+			trabajos[n].seed = (int)n;
+			trabajos[n].roughness = roughness;
+			trabajos[n].detail = 8;
+		}
+		double casillas = (double)trabajos.size() * 257 * 257;
+		for (int h = 1; h <= hilos; h = (h == hilos) ? h + 1 : hilos){
+			MapBatch lote(h);
+			NullDestino destino;
+			double t = mide([&](){ lote.generate(trabajos, destino); });
+			sprintf(campos, "\"detail\": 8, \"maps\": 256, \"threads\": %d, \"buffers\": %lld", h, lote.getReservadas());
+			resultado(campos, casillas, t);
+		}
+	}
+	cierraSeccion();
+
+	// REPRESENTACION: cada representador sobre un mapa de detalle detalleRepr, con un pixel por casilla
+	abreSeccion("render");
+	{
+		Map m(detalleRepr, 1234);
+		NullSink sink;
+		m.setRenderSink(&sink);
+		m.generate(roughness);
+		double casillas = (double)m.getSize() * m.getSize();
+		const char *nombres[] = { "mostrarVistaPlanta", "mostrarCorte", "mostrarCorte3DLR", "mostrarCorte3DRL",
+			"mostrarCorte3DFront", "mostrarCorte3DLRQuick", "mostrarCorte3DRLQuick", "mostrarCorte3DFrontQuick" };
+		// con un hilo y con todos (ver setHilosRepresentacion())
+		for (int h = 1; h <= hilos; h = (h == hilos) ? h + 1 : hilos){
+			m.setHilosRepresentacion(h);
+			for (int v = 0; v < 8; ++v){
+				long long pixelesAntes = sink.pixeles;
+				int veces = 0;
+				double t = mide([&](){
+					switch (v){
+					case 0: m.mostrarVistaPlanta(0, 0, 1, 1); break;
+					case 1: m.mostrarCorte(0, 0, 1); break;
+					case 2: m.mostrarCorte3DLR(0, 0, 1); break;
+					case 3: m.mostrarCorte3DRL(0, 0, 1); break;
+					case 4: m.mostrarCorte3DFront(0, 0, 1); break;
+					case 5: m.mostrarCorte3DLRQuick(0, 0, 1); break;
+					case 6: m.mostrarCorte3DRLQuick(0, 0, 1); break;
+					case 7: m.mostrarCorte3DFrontQuick(0, 0, 1); break;
+					}
+					++veces;
+				});
+				sprintf(campos, "\"view\": \"%s\", \"detail\": %d, \"threads\": %d, \"pixels\": %lld", nombres[v],
+					detalleRepr, h, (sink.pixeles - pixelesAntes) / veces);
+				resultado(campos, casillas, t);
+			}
+		}
+		m.setHilosRepresentacion(hilos);
+		// muestraMapa() en una ventana de 320x240, con el nivel de la piramide que quepa
+		const char *perspectivas[] = { "LR", "FRONT", "RL" };
+		for (int p = 0; p < 3; ++p){
+			Map::Pers perspectiva = (Map::Pers)p;
+			double t = mide([&](){ m.muestraMapa(0, 0, 1, perspectiva, 320, 240); });
+			sprintf(campos, "\"view\": \"muestraMapa\", \"perspective\": \"%s\", \"detail\": %d, \"window\": \"320x240\", "
+				"\"level\": %d", perspectivas[p], detalleRepr, m.nivelParaVentana(1, perspectiva, 320, 240));
+			resultado(campos, casillas, t);
+		}
+		// borrar una vista: un solo relleno de su zona, sin leer el mapa
+		const char *borrados[] = { "borrarVistaPlanta", "borrarCorte3DLR", "borrarCorte3DRLQuick" };
+		for (int v = 0; v < 3; ++v){
+			double t = mide([&](){
+				switch (v){
+				case 0: m.borrarVistaPlanta(0, 0, 1, 1); break;
+				case 1: m.borrarCorte3DLR(0, 0, 1); break;
+				case 2: m.borrarCorte3DRLQuick(0, 0, 1); break;
+				}
+			});
+			sprintf(campos, "\"view\": \"%s\", \"detail\": %d", borrados[v], detalleRepr);
+			resultado(campos, casillas, t);
+		}
+		cierraSeccion();
+
+		// REPRESENTACION INCREMENTAL: actualizaVista() despues de modificar un sector de lado 17
+		abreSeccion("actualizaVista");
+		int huecos = m.getSize() - 17 - 1;
+		for (int v = 0; v < 8; ++v){
+			switch (v){
+			case 0: m.mostrarVistaPlanta(0, 0, 1, 1); break;
+			case 1: m.mostrarCorte(0, 0, 1); break;
+			case 2: m.mostrarCorte3DLR(0, 0, 1); break;
+			case 3: m.mostrarCorte3DRL(0, 0, 1); break;
+			case 4: m.mostrarCorte3DFront(0, 0, 1); break;
+			case 5: m.mostrarCorte3DLRQuick(0, 0, 1); break;
+			case 6: m.mostrarCorte3DRLQuick(0, 0, 1); break;
+			case 7: m.mostrarCorte3DFrontQuick(0, 0, 1); break;
+			}
+			long long n = 0;
+			double t = mide([&](){
+				// altura central dentro del rango del mapa, para que no cambie la escala (que obliga a pintar todo)
+				m.modificaSector((int)((n * 7919) % huecos), (int)((n * 104729) % huecos), 4, 0.5f, m.getSize() * 3 / 4);
+				m.actualizaVista();
+				++n;
+			});
+			sprintf(campos, "\"view\": \"%s\", \"detail\": %d, \"sector\": 17", nombres[v], detalleRepr);
+			resultado(campos, 17.0 * 17, t);
+		}
+		cierraSeccion();
+		printf("\t\"checksum\": %u,\n", sink.suma);
+	}
+
+	printf("\t\"peak_rss_kb\": %lld\n}\n", picoMemoriaKB());
+	return 0;
+}
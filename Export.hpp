@@ -0,0 +1,298 @@
+#pragma once
+
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+* Exportadores de mapas a ficheros que entienden otras herramientas (ver Map::guardaAlturas() y Map::guardaColor()).
+* Todos escriben fila a fila segun se les van pasando, sin tener nunca la imagen entera en memoria: solo guardan la fila
+* que estan escribiendo.
+*
+* Los PNG no se comprimen: van en bloques "stored" de deflate, que no necesitan zlib y se escriben a la velocidad del
+* disco. El fichero ocupa lo mismo que las muestras, y cualquier lector de PNG lo abre igual.
+*/
+
+/**
+* Formato de un fichero de alturas exportado
+*/
+enum FormatoAlturas {
+	ALTURAS_FLOAT32 = 0,	// floats de 32 bits en little endian, sin cabecera (ancho * alto * 4 bytes)
+	ALTURAS_PGM16 = 1,		// PGM binario (P5) de 16 bits, de lower (0) a higher (65535)
+	ALTURAS_PNG16 = 2		// PNG en escala de grises de 16 bits, de lower (0) a higher (65535)
+};
+
+/**
+* Tablas del CRC-32, calculadas una sola vez (ver actualizaCrc32()). t[0] es la tabla normal de un byte, y t[k] la de
+* un byte seguido de k bytes a cero, para poder tratar los bytes de 4 en 4 ("slicing by 4")
+*/
+struct TablaCrc32 {
+	uint32_t t[4][256];
+
+	TablaCrc32(){
+		for (uint32_t i = 0; i < 256; ++i){
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k){
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			t[0][i] = c;
+		}
+		for (uint32_t i = 0; i < 256; ++i){
+			for (int k = 1; k < 4; ++k){
+				t[k][i] = t[0][t[k - 1][i] & 0xFF] ^ (t[k - 1][i] >> 8);
+			}
+		}
+	}
+};
+
+/**
+* CRC-32 (el de PNG y zip) de n bytes, continuando el crc de los bytes anteriores (0 para empezar)
+*/
+inline uint32_t actualizaCrc32(uint32_t crc, const uint8_t *datos, size_t n){
+	static const TablaCrc32 tabla;
+	const uint32_t (*t)[256] = tabla.t;
+	crc = ~crc;
+	for (; n >= 4; n -= 4, datos += 4){
+		crc ^= (uint32_t)datos[0] | ((uint32_t)datos[1] << 8) | ((uint32_t)datos[2] << 16) | ((uint32_t)datos[3] << 24);
+		crc = t[3][crc & 0xFF] ^ t[2][(crc >> 8) & 0xFF] ^ t[1][(crc >> 16) & 0xFF] ^ t[0][crc >> 24];
+	}
+	for (; n > 0; --n, ++datos){
+		crc = t[0][(crc ^ *datos) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+/**
+* Adler-32 (el de zlib) de n bytes, continuando el de los bytes anteriores (1 para empezar).
+* El modulo solo se hace cada 5552 bytes, que es lo maximo que se puede sumar sin desbordar 32 bits
+*/
+inline uint32_t actualizaAdler32(uint32_t adler, const uint8_t *datos, size_t n){
+	uint32_t a = adler & 0xFFFF;
+	uint32_t b = adler >> 16;
+	while (n > 0){
+		size_t bloque = (n < 5552) ? n : 5552;
+		for (size_t i = 0; i < bloque; ++i){
+			a += datos[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		datos += bloque;
+		n -= bloque;
+	}
+	return (b << 16) | a;
+}
+
+/**
+* Escribe un PNG fila a fila: de grises (1 canal) o RGB (3 canales), de 8 o 16 bits por canal.
+* Cada fila va en su propio chunk IDAT, con el byte de filtro 0 (ninguno) y sus muestras en uno o varios bloques stored
+* (de 65535 bytes como mucho). Todos los IDAT juntos forman un solo flujo zlib, que se cierra con la ultima fila
+*/
+class EscritorPNG {
+private:
+	FILE *f;
+	int alto;
+	size_t bytesFila;		// bytes de muestras de cada fila (sin el byte de filtro)
+	int filas;				// filas escritas hasta ahora
+	uint32_t adler;
+	std::vector<uint8_t> chunk;	// el IDAT de la fila actual, con su longitud y su tipo delante
+
+	// No se puede copiar (el fichero solo se cierra una vez)
+	EscritorPNG(const EscritorPNG&);
+	EscritorPNG& operator=(const EscritorPNG&);
+
+	static void pon32(uint8_t *p, uint32_t v){
+		p[0] = (uint8_t)(v >> 24);
+		p[1] = (uint8_t)(v >> 16);
+		p[2] = (uint8_t)(v >> 8);
+		p[3] = (uint8_t)v;
+	}
+
+	/**
+	* Escribe el chunk de tipo 'tipo' con los n bytes que hay a partir de chunk[8] (los 8 primeros se reservan para la
+	* longitud y el tipo), y su CRC detras
+	*/
+	bool escribeChunk(const char *tipo, size_t n){
+		chunk.resize(8 + n + 4);
+		pon32(&chunk[0], (uint32_t)n);
+		memcpy(&chunk[4], tipo, 4);
+		pon32(&chunk[8 + n], actualizaCrc32(0, &chunk[4], 4 + n));
+		return fwrite(&chunk[0], 1, chunk.size(), f) == chunk.size();
+	}
+
+public:
+	EscritorPNG(){
+		this->f = NULL;
+	}
+
+	~EscritorPNG(){
+		if (f != NULL) fclose(f);
+	}
+
+	/**
+	* Crea el fichero y escribe la cabecera de una imagen de ancho x alto. Devuelve false si no se ha podido
+	*/
+	bool abre(const char *ruta, int ancho, int alto, int bits, bool color){
+		if (f != NULL) fclose(f);
+		this->alto = alto;
+		this->bytesFila = (size_t)ancho * (color ? 3 : 1) * (bits / 8);
+		this->filas = 0;
+		this->adler = 1;
+		f = fopen(ruta, "wb");
+		if (f == NULL) return false;
+		static const uint8_t firma[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		if (fwrite(firma, 1, 8, f) != 8) return false;
+		chunk.resize(8 + 13);
+		pon32(&chunk[8], (uint32_t)ancho);
+		pon32(&chunk[12], (uint32_t)alto);
+		chunk[16] = (uint8_t)bits;
+		chunk[17] = color ? 2 : 0;	// tipo de color: 2 RGB, 0 grises
+		chunk[18] = 0;				// compresion deflate
+		chunk[19] = 0;				// filtros por fila
+		chunk[20] = 0;				// sin entrelazado
+		return escribeChunk("IHDR", 13);
+	}
+
+	/**
+	* Escribe la siguiente fila. Las muestras de 16 bits van en big endian, como las pide PNG
+	*/
+	bool fila(const uint8_t *muestras){
+		if (f == NULL || filas >= alto) return false;
+		bool primera = (filas == 0);
+		bool ultima = (filas == alto - 1);
+		size_t n = bytesFila + 1;		// con el byte de filtro
+		size_t bloques = (n + 65534) / 65535;
+		chunk.resize(8 + (primera ? 2 : 0) + n + 5 * bloques + (ultima ? 4 : 0) + 4);
+		uint8_t *p = &chunk[8];
+		if (primera){
+			*p++ = 0x78;	// cabecera zlib: deflate con ventana de 32 KB, sin diccionario
+			*p++ = 0x01;
+		}
+		const uint8_t filtro = 0;
+		adler = actualizaAdler32(adler, &filtro, 1);
+		adler = actualizaAdler32(adler, muestras, bytesFila);
+		for (size_t hecho = 0; hecho < n; ){
+			size_t trozo = (n - hecho < 65535) ? n - hecho : 65535;
+			*p++ = (ultima && hecho + trozo == n) ? 1 : 0;	// BFINAL en el ultimo bloque, tipo 00 (stored)
+			*p++ = (uint8_t)trozo;
+			*p++ = (uint8_t)(trozo >> 8);
+			*p++ = (uint8_t)~trozo;
+			*p++ = (uint8_t)(~trozo >> 8);
+			if (hecho == 0){
+				*p++ = filtro;
+				memcpy(p, muestras, trozo - 1);
+				p += trozo - 1;
+			}
+			else {
+				memcpy(p, muestras + hecho - 1, trozo);
+				p += trozo;
+			}
+			hecho += trozo;
+		}
+		if (ultima){
+			pon32(p, adler);
+			p += 4;
+		}
+		++filas;
+		return escribeChunk("IDAT", p - &chunk[8]);
+	}
+
+	/**
+	* Escribe el final del PNG y cierra el fichero. Devuelve false si falta alguna fila o no se ha podido escribir
+	*/
+	bool cierra(){
+		if (f == NULL) return false;
+		bool bien = (filas == alto) && escribeChunk("IEND", 0);
+		bien = (fclose(f) == 0) && bien;
+		f = NULL;
+		return bien;
+	}
+};
+
+/**
+* Escribe un fichero de alturas (ver FormatoAlturas) fila a fila, a partir de las alturas en float.
+* En los formatos de 16 bits, lower pasa a 0 y higher a 65535 (redondeando, y saturando lo que se salga)
+*/
+class EscritorAlturas {
+private:
+	FormatoAlturas formato;
+	FILE *f;
+	EscritorPNG png;
+	int ancho;
+	float lower;
+	float escala;			// 65535 / (higher - lower)
+	std::vector<uint8_t> bytes;	// la fila actual, ya en el formato del fichero
+
+	// No se puede copiar (el fichero solo se cierra una vez)
+	EscritorAlturas(const EscritorAlturas&);
+	EscritorAlturas& operator=(const EscritorAlturas&);
+
+public:
+	EscritorAlturas(){
+		this->formato = ALTURAS_FLOAT32;
+		this->f = NULL;
+	}
+
+	~EscritorAlturas(){
+		if (f != NULL) fclose(f);
+	}
+
+	/**
+	* Crea el fichero (con su cabecera, si el formato la tiene) para ancho x alto alturas entre lower y higher.
+	* Devuelve false si no se ha podido
+	*/
+	bool abre(const char *ruta, FormatoAlturas formato, int ancho, int alto, float lower, float higher){
+		if (f != NULL) fclose(f);
+		f = NULL;
+		this->formato = formato;
+		this->ancho = ancho;
+		this->lower = lower;
+		this->escala = (higher > lower) ? 65535 / (higher - lower) : 0;
+		this->bytes.resize((size_t)ancho * ((formato == ALTURAS_FLOAT32) ? 4 : 2));
+		if (formato == ALTURAS_PNG16) return png.abre(ruta, ancho, alto, 16, false);
+		f = fopen(ruta, "wb");
+		if (f == NULL) return false;
+		if (formato == ALTURAS_PGM16) return fprintf(f, "P5\n%d %d\n65535\n", ancho, alto) > 0;
+		return true;
+	}
+
+	/**
+	* Escribe la siguiente fila (ancho alturas)
+	*/
+	bool fila(const float *alturas){
+		uint8_t *p = bytes.empty() ? NULL : &bytes[0];
+		if (formato == ALTURAS_FLOAT32){
+			for (int x = 0; x < ancho; ++x, p += 4){
+				uint32_t v;
+				memcpy(&v, &alturas[x], 4);
+				p[0] = (uint8_t)v;
+				p[1] = (uint8_t)(v >> 8);
+				p[2] = (uint8_t)(v >> 16);
+				p[3] = (uint8_t)(v >> 24);
+			}
+		}
+		else {
+			for (int x = 0; x < ancho; ++x, p += 2){
+				float q = (alturas[x] - lower) * escala + 0.5f;
+				uint16_t v = (q <= 0) ? 0 : ((q >= 65535) ? 65535 : (uint16_t)q);
+				p[0] = (uint8_t)(v >> 8);	// big endian, tanto en PGM como en PNG
+				p[1] = (uint8_t)v;
+			}
+		}
+		if (formato == ALTURAS_PNG16) return png.fila(bytes.empty() ? NULL : &bytes[0]);
+		if (f == NULL) return false;
+		return fwrite(&bytes[0], 1, bytes.size(), f) == bytes.size();
+	}
+
+	/**
+	* Termina el fichero y lo cierra. Devuelve false si no se ha podido escribir
+	*/
+	bool cierra(){
+		if (formato == ALTURAS_PNG16) return png.cierra();
+		if (f == NULL) return false;
+		bool bien = (fclose(f) == 0);
+		f = NULL;
+		return bien;
+	}
+};
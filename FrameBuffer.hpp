@@ -0,0 +1,457 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdio.h>
+#include <stdint.h>
+#include "Stats.hpp"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/ioctl.h>
+#include <unistd.h>
+/*
+* Fuera de Windows no existe COLORREF, se define con el mismo formato (0x00BBGGRR) para que el resto del codigo
+* (calculaColor() y compania) no tenga que cambiar
+*/
+typedef uint32_t COLORREF;
+#define RGB(r,g,b) ((COLORREF)(((uint8_t)(r)) | ((uint32_t)(uint8_t)(g) << 8) | ((uint32_t)(uint8_t)(b) << 16)))
+#define GetRValue(c) ((uint8_t)(c))
+#define GetGValue(c) ((uint8_t)((c) >> 8))
+#define GetBValue(c) ((uint8_t)((c) >> 16))
+#endif
+
+/**
+* Framebuffer RGBA en memoria sobre el que pintan los metodos mostrar* de Map.
+* Cada pixel es un uint32_t con el mismo orden que COLORREF (0xAABBGGRR), es decir, en memoria (little endian)
+* los bytes quedan R, G, B, A. El canal alfa siempre vale 255 para los pixeles pintados.
+* Todas las operaciones recortan a los limites del framebuffer, igual que hacia SetPixel() con la ventana.
+*/
+class FrameBuffer {
+private:
+	int ancho;
+	int alto;
+	std::vector<uint32_t> pixeles;
+	int recorteX0, recorteY0, recorteX1, recorteY1;	// rectangulo fuera del cual no se escribe (ver fijaRecorte())
+#ifdef MAPGEN_STATS
+	long long escritos;		// pixeles escritos desde que se creo (ver Stats.hpp)
+#endif
+
+public:
+	FrameBuffer(){
+		this->ancho = 0;
+		this->alto = 0;
+		quitaRecorte();
+		MAPGEN_STAT(this->escritos = 0;)
+	}
+
+	FrameBuffer(int ancho, int alto){
+		this->ancho = 0;
+		this->alto = 0;
+		quitaRecorte();
+		MAPGEN_STAT(this->escritos = 0;)
+		reserva(ancho, alto);
+	}
+
+	/**
+	* Se asegura de que el framebuffer tenga al menos ancho x alto pixeles. Si tiene que crecer, conserva lo que
+	* ya estuviera pintado (los pixeles nuevos quedan en negro)
+	*/
+	void reserva(int ancho, int alto){
+		if (ancho <= this->ancho && alto <= this->alto) return;
+		int nuevoAncho = (ancho > this->ancho) ? ancho : this->ancho;
+		int nuevoAlto = (alto > this->alto) ? alto : this->alto;
+		std::vector<uint32_t> nuevos((size_t)nuevoAncho * nuevoAlto, 0xFF000000u);
+		for (int y = 0; y < this->alto; ++y){
+			for (int x = 0; x < this->ancho; ++x){
+				nuevos[x + (size_t)nuevoAncho * y] = pixeles[x + (size_t)this->ancho * y];
+			}
+		}
+		pixeles.swap(nuevos);
+		this->ancho = nuevoAncho;
+		this->alto = nuevoAlto;
+	}
+
+	/**
+	* Limita las escrituras (setPixel() y rellenaRect(), no limpia()) al rectangulo (x,y,w,h), hasta que se llame a
+	* quitaRecorte(). Sirve para volver a pintar solo una parte de una representacion (ver Map::actualizaVista())
+	*/
+	void fijaRecorte(int x, int y, int w, int h){
+		this->recorteX0 = x;
+		this->recorteY0 = y;
+		this->recorteX1 = x + w;
+		this->recorteY1 = y + h;
+	}
+
+	void quitaRecorte(){
+		this->recorteX0 = 0;
+		this->recorteY0 = 0;
+		this->recorteX1 = 0x7FFFFFFF;
+		this->recorteY1 = 0x7FFFFFFF;
+	}
+
+	/**
+	* Devuelve el recorte en (x0,y0)-(x1,y1), sin incluir x1 ni y1. Devuelve false si no hay recorte
+	*/
+	bool getRecorte(int &x0, int &y0, int &x1, int &y1) const {
+		x0 = recorteX0;
+		y0 = recorteY0;
+		x1 = recorteX1;
+		y1 = recorteY1;
+		return x1 != 0x7FFFFFFF;
+	}
+
+	/**
+	* Recorta el rectangulo (x,y,w,h) a los limites del framebuffer (y al recorte, si lo hay). Devuelve false si queda
+	* vacio
+	*/
+	bool recorta(int &x, int &y, int &w, int &h) const {
+		int x0 = (recorteX0 > 0) ? recorteX0 : 0;
+		int y0 = (recorteY0 > 0) ? recorteY0 : 0;
+		int x1 = (recorteX1 < ancho) ? recorteX1 : ancho;
+		int y1 = (recorteY1 < alto) ? recorteY1 : alto;
+		if (x < x0){ w -= x0 - x; x = x0; }
+		if (y < y0){ h -= y0 - y; y = y0; }
+		if (x + w > x1) w = x1 - x;
+		if (y + h > y1) h = y1 - y;
+		return w > 0 && h > 0;
+	}
+
+	/**
+	* Equivalente a SetPixel(), pero escribiendo directamente en memoria
+	*/
+	inline void setPixel(int x, int y, COLORREF color){
+		if ((unsigned)x < (unsigned)ancho && (unsigned)y < (unsigned)alto && x >= recorteX0 && x < recorteX1 &&
+			y >= recorteY0 && y < recorteY1){
+			pixeles[x + (size_t)ancho * y] = (uint32_t)color | 0xFF000000u;
+			MAPGEN_STAT(++escritos;)
+		}
+	}
+
+	inline uint32_t getPixel(int x, int y) const {
+		return pixeles[x + (size_t)ancho * y];
+	}
+
+	/**
+	* Rellena el rectangulo (x,y,w,h) con un color
+	*/
+	void rellenaRect(int x, int y, int w, int h, COLORREF color){
+		cuentaEscritos(rellenaRectSinContar(x, y, w, h, color));
+	}
+
+	/*
+	* Para pintar desde varios hilos a la vez, cada uno en sus propios pixeles: setPixel() y rellenaRect() llevan la
+	* cuenta de pixeles escritos (con MAPGEN_STATS), que no se puede tocar desde varios hilos. Estas no la tocan, y lo
+	* escrito se suma al final, desde un solo hilo, con cuentaEscritos()
+	*/
+
+	/**
+	* Como rellenaRect(), pero sin contar los pixeles. Devuelve cuantos ha escrito
+	*/
+	long long rellenaRectSinContar(int x, int y, int w, int h, COLORREF color){
+		if (!recorta(x, y, w, h)) return 0;
+		uint32_t c = (uint32_t)color | 0xFF000000u;
+		for (int j = y; j < y + h; ++j){
+			uint32_t *fila = &pixeles[x + (size_t)ancho * j];
+			for (int i = 0; i < w; ++i){
+				fila[i] = c;
+			}
+		}
+		return (long long)w * h;
+	}
+
+	/**
+	* Escribe un pixel que ya se sabe dentro del framebuffer y del recorte, sin comprobarlo y sin contarlo
+	*/
+	inline void ponPixel(int x, int y, COLORREF color){
+		pixeles[x + (size_t)ancho * y] = (uint32_t)color | 0xFF000000u;
+	}
+
+	/**
+	* Suma n pixeles a la cuenta de escritos (los de rellenaRectSinContar() y ponPixel())
+	*/
+	void cuentaEscritos(long long n){
+		MAPGEN_STAT(escritos += n;)
+		(void)n;	// sin MAPGEN_STATS no se cuenta nada
+	}
+
+	/**
+	* Pone todo el framebuffer de un color (por defecto negro)
+	*/
+	void limpia(COLORREF color = RGB(0, 0, 0)){
+		std::fill(pixeles.begin(), pixeles.end(), (uint32_t)color | 0xFF000000u);
+		MAPGEN_STAT(escritos += (long long)pixeles.size();)
+	}
+
+#ifdef MAPGEN_STATS
+	/**
+	* Pixeles escritos (con setPixel() y rellenaRect()) desde que se creo el framebuffer
+	*/
+	long long getPixelesEscritos() const {
+		return escritos;
+	}
+#endif
+
+	int getAncho() const {
+		return ancho;
+	}
+
+	int getAlto() const {
+		return alto;
+	}
+
+	uint32_t* getPixeles(){
+		return pixeles.empty() ? NULL : &pixeles[0];
+	}
+
+	const uint32_t* getPixeles() const {
+		return pixeles.empty() ? NULL : &pixeles[0];
+	}
+
+	/**
+	* Guarda el framebuffer completo como imagen PPM (binaria). Devuelve false si no se ha podido escribir
+	*/
+	bool guardaPPM(const char *ruta) const {
+		FILE *f = fopen(ruta, "wb");
+		if (f == NULL) return false;
+		fprintf(f, "P6\n%d %d\n255\n", ancho, alto);
+		std::vector<uint8_t> fila((size_t)ancho * 3);
+		for (int y = 0; y < alto; ++y){
+			for (int x = 0; x < ancho; ++x){
+				uint32_t p = pixeles[x + (size_t)ancho * y];
+				fila[3 * x] = (uint8_t)p;
+				fila[3 * x + 1] = (uint8_t)(p >> 8);
+				fila[3 * x + 2] = (uint8_t)(p >> 16);
+			}
+			if (!fila.empty()) fwrite(&fila[0], 1, fila.size(), f);
+		}
+		return fclose(f) == 0;
+	}
+};
+
+/**
+* Destino al que se vuelca (una sola vez por representacion) la zona del framebuffer que se acaba de pintar.
+* El framebuffer es la representacion "real"; el destino solo la muestra (ventana, terminal, fichero...)
+*/
+class RenderSink {
+public:
+	virtual ~RenderSink(){}
+
+	/**
+	* Muestra el rectangulo (x,y,ancho,alto) del framebuffer, ya recortado a sus limites
+	*/
+	virtual void presenta(const FrameBuffer &fb, int x, int y, int ancho, int alto) = 0;
+};
+
+#ifdef _WIN32
+/**
+* Vuelca el framebuffer a un HDC de GDI (por defecto el de la consola) con un solo SetDIBitsToDevice()
+*/
+class GdiSink : public RenderSink {
+private:
+	HDC hdc;
+	std::vector<uint32_t> bgra;	// GDI espera los pixeles como BGRA, se convierten aqui antes de volcar
+
+public:
+	GdiSink(HDC hdc){
+		this->hdc = hdc;
+	}
+
+	void presenta(const FrameBuffer &fb, int x, int y, int ancho, int alto){
+		bgra.resize((size_t)ancho * alto);
+		for (int j = 0; j < alto; ++j){
+			for (int i = 0; i < ancho; ++i){
+				uint32_t p = fb.getPixel(x + i, y + j);
+				bgra[i + (size_t)ancho * j] = (p & 0xFF00FF00u) | ((p & 0xFF) << 16) | ((p >> 16) & 0xFF);
+			}
+		}
+		BITMAPINFO bmi;
+		ZeroMemory(&bmi, sizeof(bmi));
+		bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+		bmi.bmiHeader.biWidth = ancho;
+		bmi.bmiHeader.biHeight = -alto;	// negativo: las filas van de arriba a abajo, como en el framebuffer
+		bmi.bmiHeader.biPlanes = 1;
+		bmi.bmiHeader.biBitCount = 32;
+		bmi.bmiHeader.biCompression = BI_RGB;
+		SetDIBitsToDevice(hdc, x, y, ancho, alto, 0, 0, 0, alto, &bgra[0], &bmi, DIB_RGB_COLORS);
+	}
+
+	HDC getHdc(){
+		return hdc;
+	}
+
+	/**
+	* Destino compartido para la ventana de la consola
+	*/
+	static GdiSink* consola(){
+		static GdiSink s(GetDC(GetConsoleWindow()));
+		return &s;
+	}
+};
+#endif
+
+/**
+* Vuelca el framebuffer a una terminal con color de 24 bits (secuencias ANSI), para ver los mapas sin ventana, p.ej. por
+* SSH. Cada caracter muestra dos pixeles, uno encima del otro, con el medio bloque superior: el de arriba es el color
+* del texto y el de abajo el del fondo (si son iguales, un espacio con ese fondo).
+* Se acuerda de lo que ha dejado en cada caracter, y en cada volcado solo escribe los que han cambiado (nada, si no ha
+* cambiado ninguno), sin borrar nunca la pantalla. Si algo mas escribe en la terminal, reinicia() hace que el siguiente
+* volcado lo vuelva a escribir todo.
+* El pixel (0,0) va en la esquina de arriba a la izquierda de la terminal, y no se escribe fuera de las primeras
+* columnas x filas celdas (0 para no limitar)
+*/
+class TerminalSink : public RenderSink {
+private:
+	FILE *f;
+	int columnas, filas;
+	int anchoCeldas, altoCeldas;	// celdas de las que se sabe lo que hay (las que se han escrito alguna vez)
+	std::vector<uint64_t> celdas;	// pixel de arriba << 32 | pixel de abajo, o 0 si no se sabe que hay
+	std::string secuencias;			// lo que se va a escribir en el volcado actual, para escribirlo de una vez
+	long long escritos;				// bytes escritos desde que se creo
+
+	/**
+	* Se asegura de que la rejilla de celdas tenga al menos ancho x alto, sin perder lo que ya sabia
+	*/
+	void crece(int ancho, int alto){
+		if (ancho <= anchoCeldas && alto <= altoCeldas) return;
+		int nuevoAncho = (ancho > anchoCeldas) ? ancho : anchoCeldas;
+		int nuevoAlto = (alto > altoCeldas) ? alto : altoCeldas;
+		std::vector<uint64_t> nuevas((size_t)nuevoAncho * nuevoAlto, 0);
+		for (int j = 0; j < altoCeldas; ++j){
+			for (int i = 0; i < anchoCeldas; ++i){
+				nuevas[i + (size_t)nuevoAncho * j] = celdas[i + (size_t)anchoCeldas * j];
+			}
+		}
+		celdas.swap(nuevas);
+		anchoCeldas = nuevoAncho;
+		altoCeldas = nuevoAlto;
+	}
+
+	/**
+	* Anade la secuencia que pone el color del pixel p como color del texto (38) o del fondo (48)
+	*/
+	void ponColor(int capa, uint32_t p){
+		char buf[32];
+		int n = snprintf(buf, sizeof(buf), "\x1b[%d;2;%u;%u;%um", capa, p & 0xFF, (p >> 8) & 0xFF, (p >> 16) & 0xFF);
+		secuencias.append(buf, n);
+	}
+
+	void ponCursor(int fila, int columna){
+		char buf[32];
+		int n = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", fila + 1, columna + 1);
+		secuencias.append(buf, n);
+	}
+
+public:
+	TerminalSink(FILE *f = stdout, int columnas = 0, int filas = 0){
+		this->f = f;
+		this->columnas = columnas;
+		this->filas = filas;
+		this->anchoCeldas = 0;
+		this->altoCeldas = 0;
+		this->escritos = 0;
+	}
+
+	void presenta(const FrameBuffer &fb, int x, int y, int ancho, int alto){
+		int c0 = x;
+		int c1 = x + ancho;
+		int f0 = y / 2;
+		int f1 = (y + alto + 1) / 2;
+		if (columnas > 0 && c1 > columnas) c1 = columnas;
+		if (filas > 0 && f1 > filas) f1 = filas;
+		if (c0 >= c1 || f0 >= f1) return;
+		crece(c1, f1);
+		secuencias.clear();
+		uint32_t texto = 0, fondo = 0;		// colores puestos ahora en la terminal (0 si ninguno)
+		int filaCursor = -1, columnaCursor = -1;
+		for (int fila = f0; fila < f1; ++fila){
+			bool conAbajo = (2 * fila + 1 < fb.getAlto());
+			for (int col = c0; col < c1; ++col){
+				uint32_t arriba = fb.getPixel(col, 2 * fila);
+				uint32_t abajo = conAbajo ? fb.getPixel(col, 2 * fila + 1) : 0xFF000000u;
+				uint64_t celda = ((uint64_t)arriba << 32) | abajo;
+				uint64_t &antes = celdas[col + (size_t)anchoCeldas * fila];
+				if (antes == celda) continue;
+				antes = celda;
+				if (fila != filaCursor || col != columnaCursor) ponCursor(fila, col);
+				if (abajo != fondo){
+					ponColor(48, abajo);
+					fondo = abajo;
+				}
+				if (arriba == abajo){
+					secuencias += ' ';
+				}
+				else {
+					if (arriba != texto){
+						ponColor(38, arriba);
+						texto = arriba;
+					}
+					secuencias += "\xE2\x96\x80";	// U+2580, medio bloque superior
+				}
+				filaCursor = fila;
+				columnaCursor = col + 1;
+			}
+		}
+		if (secuencias.empty()) return;
+		secuencias += "\x1b[0m";
+		ponCursor(altoCeldas, 0);	// debajo de todo lo pintado, para que lo que se escriba despues no caiga encima
+		escritos += (long long)fwrite(secuencias.data(), 1, secuencias.size(), f);
+		fflush(f);
+	}
+
+	/**
+	* Olvida lo que habia en la terminal: el siguiente volcado escribe todos sus caracteres (p.ej. despues de limpiarla)
+	*/
+	void reinicia(){
+		std::fill(celdas.begin(), celdas.end(), (uint64_t)0);
+	}
+
+	/**
+	* Bytes escritos en la terminal desde que se creo
+	*/
+	long long getBytesEscritos() const {
+		return escritos;
+	}
+
+	/**
+	* Tamano de la terminal de la salida estandar, en caracteres. Devuelve false si no es una terminal
+	*/
+	static bool tamTerminal(int &columnas, int &filas){
+#ifdef _WIN32
+		CONSOLE_SCREEN_BUFFER_INFO info;
+		if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) return false;
+		columnas = info.srWindow.Right - info.srWindow.Left + 1;
+		filas = info.srWindow.Bottom - info.srWindow.Top + 1;
+		return true;
+#else
+		struct winsize ws;
+		if (!isatty(STDOUT_FILENO) || ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0) return false;
+		columnas = ws.ws_col;
+		filas = ws.ws_row;
+		return true;
+#endif
+	}
+
+	/**
+	* Destino compartido para la terminal de la salida estandar, limitado a su tamano (menos la ultima fila, para que el
+	* cursor quede debajo sin hacer scroll)
+	*/
+	static TerminalSink* consola(){
+		static TerminalSink s = creaConsola();
+		return &s;
+	}
+
+private:
+	static TerminalSink creaConsola(){
+		int columnas = 0, filas = 0;
+		if (tamTerminal(columnas, filas) && filas > 1) --filas;
+#ifdef _WIN32
+		// las consolas de Windows solo entienden las secuencias ANSI si se les pide
+		DWORD modo;
+		HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
+		if (GetConsoleMode(h, &modo)) SetConsoleMode(h, modo | 0x0004);	// ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#endif
+		return TerminalSink(stdout, columnas, filas);
+	}
+};
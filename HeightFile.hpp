@@ -0,0 +1,218 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "Samples.hpp"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/**
+* Cabecera de un fichero de alturas. Va al principio del fichero, y justo detras (a partir del byte 64) la matriz de
+* alturas, fila a fila, en el tipo de muestra del mapa (ver Samples.hpp). Los ficheros anteriores a los tipos de muestra
+* tienen a 0 los campos muestra, cuantBase y cuantPaso, que es justo lo que corresponde a float
+*/
+struct CabeceraAlturas {
+	char magic[8];			// "MAPGEN2"
+	uint32_t version;
+	int32_t detail;
+	int32_t seed;
+	float roughness;
+	float higher;
+	float lower;
+	uint32_t generado;		// 0 mientras el mapa no se ha terminado de generar
+	uint32_t muestra;		// tipo de muestra (TipoMuestra)
+	float cuantBase;		// cuantizacion de las muestras (ver Cuantizacion<uint16_t>)
+	float cuantPaso;
+	uint8_t reservado[16];
+};
+
+/**
+* Fichero de alturas proyectado en memoria (mmap en POSIX, MapViewOfFile en Windows).
+* Un mapa construido sobre un HeightFile (ver BasicMap(HeightFile&)) genera directamente sobre el fichero, sin tener
+* la matriz entera en memoria: el sistema operativo va llevando las paginas a disco segun hace falta. Otro proceso
+* puede despues abrir el mismo fichero en solo lectura y usar las alturas tal cual, sin copiarlas ni regenerarlas.
+*/
+class HeightFile {
+private:
+	CabeceraAlturas *cabecera;
+	size_t bytes;
+	bool soloLectura;
+#ifdef _WIN32
+	HANDLE fichero;
+	HANDLE proyeccion;
+#else
+	int fichero;
+#endif
+
+	// No se puede copiar (la proyeccion solo se deshace una vez)
+	HeightFile(const HeightFile&);
+	HeightFile& operator=(const HeightFile&);
+
+	static size_t bytesPara(int detail, uint32_t muestra){
+		size_t size = ((size_t)1 << detail) + 1;
+		return sizeof(CabeceraAlturas) + size * size * bytesMuestra(muestra);
+	}
+
+	bool proyecta(const char *ruta, size_t bytes, bool crear){
+		cierra();
+		this->soloLectura = !crear;
+#ifdef _WIN32
+		fichero = CreateFileA(ruta, crear ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ, NULL,
+			crear ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (fichero == INVALID_HANDLE_VALUE) return false;
+		if (!crear){
+			LARGE_INTEGER tam;
+			GetFileSizeEx(fichero, &tam);
+			bytes = (size_t)tam.QuadPart;
+		}
+		proyeccion = CreateFileMappingA(fichero, NULL, crear ? PAGE_READWRITE : PAGE_READONLY,
+			(DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, NULL);
+		if (proyeccion == NULL){
+			cierra();
+			return false;
+		}
+		void *p = MapViewOfFile(proyeccion, crear ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, bytes);
+		if (p == NULL){
+			cierra();
+			return false;
+		}
+#else
+		fichero = crear ? open(ruta, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(ruta, O_RDONLY);
+		if (fichero < 0) return false;
+		if (crear){
+			if (ftruncate(fichero, (off_t)bytes) != 0){
+				cierra();
+				return false;
+			}
+		}
+		else {
+			struct stat st;
+			if (fstat(fichero, &st) != 0){
+				cierra();
+				return false;
+			}
+			bytes = (size_t)st.st_size;
+		}
+		if (bytes < sizeof(CabeceraAlturas)){
+			cierra();
+			return false;
+		}
+		void *p = mmap(NULL, bytes, crear ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fichero, 0);
+		if (p == MAP_FAILED){
+			cierra();
+			return false;
+		}
+#endif
+		this->cabecera = (CabeceraAlturas*)p;
+		this->bytes = bytes;
+		return true;
+	}
+
+public:
+	HeightFile(){
+		cabecera = NULL;
+		bytes = 0;
+		soloLectura = true;
+#ifdef _WIN32
+		fichero = INVALID_HANDLE_VALUE;
+		proyeccion = NULL;
+#else
+		fichero = -1;
+#endif
+	}
+
+	~HeightFile(){
+		cierra();
+	}
+
+	/**
+	* Crea (o vacia, si ya existia) el fichero para un mapa del nivel de detalle dado, y lo proyecta en lectura/escritura.
+	* muestra es el tipo de muestra del mapa que se va a generar en el (Cuantizacion<Sample>::tipo).
+	* Devuelve false si no se ha podido crear
+	*/
+	bool crea(const char *ruta, int detail, int seed, uint32_t muestra = MUESTRA_FLOAT){
+		if (bytesMuestra(muestra) == 0) return false;
+		if (!proyecta(ruta, bytesPara(detail, muestra), true)) return false;
+		memset(cabecera, 0, sizeof(CabeceraAlturas));
+		memcpy(cabecera->magic, "MAPGEN2", 8);
+		cabecera->version = 1;
+		cabecera->detail = detail;
+		cabecera->seed = seed;
+		cabecera->muestra = muestra;
+		return true;
+	}
+
+	/**
+	* Abre en solo lectura un fichero ya generado. Devuelve false si no existe, no es un fichero de alturas, o el mapa
+	* no se llego a terminar de generar
+	*/
+	bool abre(const char *ruta){
+		if (!proyecta(ruta, 0, false)) return false;
+		if (memcmp(cabecera->magic, "MAPGEN2", 8) != 0 || cabecera->version != 1 || cabecera->detail < 0 ||
+			cabecera->detail > 16 || bytesMuestra(cabecera->muestra) == 0 ||
+			bytes < bytesPara(cabecera->detail, cabecera->muestra) || !cabecera->generado){
+			cierra();
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	* Deshace la proyeccion y cierra el fichero (lo escrito ya queda en el fichero)
+	*/
+	void cierra(){
+#ifdef _WIN32
+		if (cabecera != NULL) UnmapViewOfFile(cabecera);
+		if (proyeccion != NULL) CloseHandle(proyeccion);
+		if (fichero != INVALID_HANDLE_VALUE) CloseHandle(fichero);
+		proyeccion = NULL;
+		fichero = INVALID_HANDLE_VALUE;
+#else
+		if (cabecera != NULL) munmap(cabecera, bytes);
+		if (fichero >= 0) close(fichero);
+		fichero = -1;
+#endif
+		cabecera = NULL;
+		bytes = 0;
+	}
+
+	/**
+	* Marca el mapa como generado y guarda sus datos en la cabecera (cuantBase y cuantPaso, los de su Cuantizacion)
+	*/
+	void guardaCabecera(int seed, float roughness, float higher, float lower, float cuantBase, float cuantPaso){
+		if (cabecera == NULL || soloLectura) return;
+		cabecera->seed = seed;
+		cabecera->roughness = roughness;
+		cabecera->higher = higher;
+		cabecera->lower = lower;
+		cabecera->cuantBase = cuantBase;
+		cabecera->cuantPaso = cuantPaso;
+		cabecera->generado = 1;
+	}
+
+	bool abierto() const {
+		return cabecera != NULL;
+	}
+
+	bool esSoloLectura() const {
+		return soloLectura;
+	}
+
+	const CabeceraAlturas* getCabecera() const {
+		return cabecera;
+	}
+
+	/**
+	* Matriz de alturas proyectada, con muestras del tipo getCabecera()->muestra (en un fichero abierto en solo lectura,
+	* no se debe escribir en ella)
+	*/
+	void* getAlturas(){
+		return (cabecera == NULL) ? NULL : (void*)(cabecera + 1);
+	}
+};
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+* Kernels del algoritmo Diamond-Square: calculan una fila entera de medias (square o diamond) a un paso dado, o los
+* limites (minimo y maximo) de una fila ya calculada.
+* Hay una version escalar, que vale para cualquier maquina, y versiones vectoriales (AVX2 en x86, NEON en ARM64).
+* Cual se usa se decide una sola vez, en tiempo de ejecucion, segun lo que soporte la CPU (ver eligeKernelFila()).
+* Todas las versiones dan exactamente el mismo resultado, bit a bit.
+*
+* Definiendo MAPGEN_NO_SIMD se fuerza siempre la version escalar.
+*/
+
+#if !defined(MAPGEN_NO_SIMD) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define MAPGEN_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define MAPGEN_AVX2
+#else
+#define MAPGEN_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if !defined(MAPGEN_NO_SIMD) && (defined(__aarch64__) || defined(_M_ARM64))
+#define MAPGEN_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+* Mezcla los bits de un entero de 32 bits (finalizador de MurmurHash3)
+*/
+inline uint32_t mezclaHash(uint32_t h){
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	return h;
+}
+
+/**
+* Hash de una fila (seed, lado, y). Se separa de hashCelda() para poder calcularlo una sola vez por fila
+*/
+inline uint32_t hashFila(uint32_t seed, uint32_t lado, uint32_t y){
+	return mezclaHash(mezclaHash(seed ^ (lado * 0x9E3779B9u)) ^ (y * 0x85EBCA77u));
+}
+
+/**
+* Hash de una casilla a partir del hash de su fila
+*/
+inline uint32_t hashCelda(uint32_t hFila, uint32_t x){
+	return mezclaHash(hFila ^ (x * 0xC2B2AE3Du));
+}
+
+/**
+* Hash de una casilla (seed, lado, x, y), del que sale su offset aleatorio
+*/
+inline uint32_t hashCelda(uint32_t seed, uint32_t lado, uint32_t x, uint32_t y){
+	return hashCelda(hashFila(seed, lado, y), x);
+}
+
+/**
+* Convierte un hash en un float entre 0 y 1 (sin llegar a 1), usando sus 24 bits altos
+*/
+inline float hashToFloat(uint32_t h){
+	return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+/**
+* Prototipo comun de los kernels de fila.
+* Para k entre 0 y n-1, con i = k*paso:
+*	dst[i] = (t0[i] + t1[i] + t2[i]) / 3 + offset
+* siendo offset el valor aleatorio (entre -scale y scale) de la casilla x0 + i de la fila cuyo hash es hFila.
+* t0, t1 y t2 apuntan al primer vecino de cada tipo, asi el mismo kernel vale para square (esquinas) y diamond (lados).
+*/
+typedef void (*KernelFila)(float *dst, const float *t0, const float *t1, const float *t2, int n, int paso,
+	int x0, uint32_t hFila, float scale);
+
+inline void kernelFilaEscalar(float *dst, const float *t0, const float *t1, const float *t2, int n, int paso,
+	int x0, uint32_t hFila, float scale){
+	for (int k = 0, i = 0; k < n; ++k, i += paso){
+		float r = hashToFloat(hashCelda(hFila, x0 + i));
+		dst[i] = (t0[i] + t1[i] + t2[i]) / 3 + (r * scale * 2 - scale);
+	}
+}
+
+#ifdef MAPGEN_X86
+/**
+* Version AVX2: 8 casillas por vuelta. Los vecinos se leen con gather (estan separados 'paso' floats) y el hash de
+* las 8 casillas se calcula a la vez con multiplicaciones enteras de 32 bits
+*/
+MAPGEN_AVX2 inline void kernelFilaAvx2(float *dst, const float *t0, const float *t1, const float *t2, int n, int paso,
+	int x0, uint32_t hFila, float scale){
+	const __m256i indices = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(paso));
+	const __m256i vHash = _mm256_set1_epi32((int)hFila);
+	const __m256i m0 = _mm256_set1_epi32((int)0xC2B2AE3Du);
+	const __m256i m1 = _mm256_set1_epi32((int)0x85EBCA6Bu);
+	const __m256i m2 = _mm256_set1_epi32((int)0xC2B2AE35u);
+	const __m256 tres = _mm256_set1_ps(3.0f);
+	const __m256 dos = _mm256_set1_ps(2.0f);
+	const __m256 norma = _mm256_set1_ps(1.0f / 16777216.0f);
+	const __m256 vScale = _mm256_set1_ps(scale);
+	float valores[8];
+	int k = 0;
+	for (; k + 8 <= n; k += 8){
+		int i = k * paso;
+		__m256i idx = _mm256_add_epi32(_mm256_set1_epi32(i), indices);
+		__m256 a = _mm256_i32gather_ps(t0, idx, 4);
+		__m256 b = _mm256_i32gather_ps(t1, idx, 4);
+		__m256 c = _mm256_i32gather_ps(t2, idx, 4);
+		__m256 media = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(a, b), c), tres);
+
+		__m256i x = _mm256_add_epi32(idx, _mm256_set1_epi32(x0));
+		__m256i h = _mm256_xor_si256(vHash, _mm256_mullo_epi32(x, m0));
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+		h = _mm256_mullo_epi32(h, m1);
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 13));
+		h = _mm256_mullo_epi32(h, m2);
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+		__m256 r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(h, 8)), norma);
+		__m256 offset = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(r, vScale), dos), vScale);
+
+		_mm256_storeu_ps(valores, _mm256_add_ps(media, offset));
+		for (int j = 0; j < 8; ++j){
+			dst[i + j * paso] = valores[j];
+		}
+	}
+	int i = k * paso;
+	kernelFilaEscalar(dst + i, t0 + i, t1 + i, t2 + i, n - k, paso, x0 + i, hFila, scale);
+}
+
+/**
+* Comprueba si la CPU (y el sistema operativo) soportan AVX2
+*/
+inline bool cpuTieneAvx2(){
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx) return false;
+	if ((_xgetbv(0) & 6) != 6) return false;	// el sistema guarda los registros XMM e YMM
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+#ifdef MAPGEN_NEON
+/**
+* Version NEON: 4 casillas por vuelta
+*/
+inline void kernelFilaNeon(float *dst, const float *t0, const float *t1, const float *t2, int n, int paso,
+	int x0, uint32_t hFila, float scale){
+	const uint32x4_t vHash = vdupq_n_u32(hFila);
+	const float32x4_t tres = vdupq_n_f32(3.0f);
+	const float32x4_t dos = vdupq_n_f32(2.0f);
+	const float32x4_t norma = vdupq_n_f32(1.0f / 16777216.0f);
+	const float32x4_t vScale = vdupq_n_f32(scale);
+	float a[4], b[4], c[4], valores[4];
+	uint32_t xs[4];
+	int k = 0;
+	for (; k + 4 <= n; k += 4){
+		int i = k * paso;
+		for (int j = 0; j < 4; ++j){
+			a[j] = t0[i + j * paso];
+			b[j] = t1[i + j * paso];
+			c[j] = t2[i + j * paso];
+			xs[j] = (uint32_t)(x0 + i + j * paso);
+		}
+		float32x4_t media = vdivq_f32(vaddq_f32(vaddq_f32(vld1q_f32(a), vld1q_f32(b)), vld1q_f32(c)), tres);
+
+		uint32x4_t h = veorq_u32(vHash, vmulq_u32(vld1q_u32(xs), vdupq_n_u32(0xC2B2AE3Du)));
+		h = veorq_u32(h, vshrq_n_u32(h, 16));
+		h = vmulq_u32(h, vdupq_n_u32(0x85EBCA6Bu));
+		h = veorq_u32(h, vshrq_n_u32(h, 13));
+		h = vmulq_u32(h, vdupq_n_u32(0xC2B2AE35u));
+		h = veorq_u32(h, vshrq_n_u32(h, 16));
+		float32x4_t r = vmulq_f32(vcvtq_f32_u32(vshrq_n_u32(h, 8)), norma);
+		float32x4_t offset = vsubq_f32(vmulq_f32(vmulq_f32(r, vScale), dos), vScale);
+
+		vst1q_f32(valores, vaddq_f32(media, offset));
+		for (int j = 0; j < 4; ++j){
+			dst[i + j * paso] = valores[j];
+		}
+	}
+	int i = k * paso;
+	kernelFilaEscalar(dst + i, t0 + i, t1 + i, t2 + i, n - k, paso, x0 + i, hFila, scale);
+}
+#endif
+
+/**
+* Prototipo comun de los kernels de fila con offsets ya calculados (los del generador del mapa, ver OffsetsRng en
+* Map.hpp). Igual que KernelFila, pero el valor aleatorio de la casilla k es r[k], en vez de salir de su hash:
+*	dst[i] = (t0[i] + t1[i] + t2[i]) / 3 + (r[k] * scale * 2 - scale)
+*/
+typedef void (*KernelFilaOffsets)(float *dst, const float *t0, const float *t1, const float *t2, int n, int paso,
+	const float *r, float scale);
+
+inline void kernelFilaOffsetsEscalar(float *dst, const float *t0, const float *t1, const float *t2, int n, int paso,
+	const float *r, float scale){
+	for (int k = 0, i = 0; k < n; ++k, i += paso){
+		dst[i] = (t0[i] + t1[i] + t2[i]) / 3 + (r[k] * scale * 2 - scale);
+	}
+}
+
+#ifdef MAPGEN_X86
+/**
+* Version AVX2: 8 casillas por vuelta, con los vecinos leidos con gather como en kernelFilaAvx2()
+*/
+MAPGEN_AVX2 inline void kernelFilaOffsetsAvx2(float *dst, const float *t0, const float *t1, const float *t2, int n,
+	int paso, const float *r, float scale){
+	const __m256i indices = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(paso));
+	const __m256 tres = _mm256_set1_ps(3.0f);
+	const __m256 dos = _mm256_set1_ps(2.0f);
+	const __m256 vScale = _mm256_set1_ps(scale);
+	float valores[8];
+	int k = 0;
+	for (; k + 8 <= n; k += 8){
+		int i = k * paso;
+		__m256i idx = _mm256_add_epi32(_mm256_set1_epi32(i), indices);
+		__m256 a = _mm256_i32gather_ps(t0, idx, 4);
+		__m256 b = _mm256_i32gather_ps(t1, idx, 4);
+		__m256 c = _mm256_i32gather_ps(t2, idx, 4);
+		__m256 media = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(a, b), c), tres);
+		__m256 offset = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(r + k), vScale), dos), vScale);
+
+		_mm256_storeu_ps(valores, _mm256_add_ps(media, offset));
+		for (int j = 0; j < 8; ++j){
+			dst[i + j * paso] = valores[j];
+		}
+	}
+	int i = k * paso;
+	kernelFilaOffsetsEscalar(dst + i, t0 + i, t1 + i, t2 + i, n - k, paso, r + k, scale);
+}
+#endif
+
+#ifdef MAPGEN_NEON
+/**
+* Version NEON: 4 casillas por vuelta
+*/
+inline void kernelFilaOffsetsNeon(float *dst, const float *t0, const float *t1, const float *t2, int n, int paso,
+	const float *r, float scale){
+	const float32x4_t tres = vdupq_n_f32(3.0f);
+	const float32x4_t dos = vdupq_n_f32(2.0f);
+	const float32x4_t vScale = vdupq_n_f32(scale);
+	float a[4], b[4], c[4], valores[4];
+	int k = 0;
+	for (; k + 4 <= n; k += 4){
+		int i = k * paso;
+		for (int j = 0; j < 4; ++j){
+			a[j] = t0[i + j * paso];
+			b[j] = t1[i + j * paso];
+			c[j] = t2[i + j * paso];
+		}
+		float32x4_t media = vdivq_f32(vaddq_f32(vaddq_f32(vld1q_f32(a), vld1q_f32(b)), vld1q_f32(c)), tres);
+		float32x4_t offset = vsubq_f32(vmulq_f32(vmulq_f32(vld1q_f32(r + k), vScale), dos), vScale);
+
+		vst1q_f32(valores, vaddq_f32(media, offset));
+		for (int j = 0; j < 4; ++j){
+			dst[i + j * paso] = valores[j];
+		}
+	}
+	int i = k * paso;
+	kernelFilaOffsetsEscalar(dst + i, t0 + i, t1 + i, t2 + i, n - k, paso, r + k, scale);
+}
+#endif
+
+/**
+* Prototipo comun de los kernels de limites: actualiza menor y mayor con los n valores de v (si alguno es menor que
+* menor o mayor que mayor)
+*/
+typedef void (*KernelLimites)(const float *v, int n, float &menor, float &mayor);
+
+inline void kernelLimitesEscalar(const float *v, int n, float &menor, float &mayor){
+	for (int i = 0; i < n; ++i){
+		if (v[i] < menor) menor = v[i];
+		if (v[i] > mayor) mayor = v[i];
+	}
+}
+
+#ifdef MAPGEN_X86
+/**
+* Version AVX2: 8 valores por vuelta, y al final se reducen las 8 calles
+*/
+MAPGEN_AVX2 inline void kernelLimitesAvx2(const float *v, int n, float &menor, float &mayor){
+	int k = 0;
+	if (n >= 8){
+		__m256 vMenor = _mm256_loadu_ps(v);
+		__m256 vMayor = vMenor;
+		for (k = 8; k + 8 <= n; k += 8){
+			__m256 x = _mm256_loadu_ps(v + k);
+			vMenor = _mm256_min_ps(vMenor, x);
+			vMayor = _mm256_max_ps(vMayor, x);
+		}
+		float a[8], b[8];
+		_mm256_storeu_ps(a, vMenor);
+		_mm256_storeu_ps(b, vMayor);
+		kernelLimitesEscalar(a, 8, menor, mayor);
+		kernelLimitesEscalar(b, 8, menor, mayor);
+	}
+	kernelLimitesEscalar(v + k, n - k, menor, mayor);
+}
+#endif
+
+#ifdef MAPGEN_NEON
+/**
+* Version NEON: 4 valores por vuelta
+*/
+inline void kernelLimitesNeon(const float *v, int n, float &menor, float &mayor){
+	int k = 0;
+	if (n >= 4){
+		float32x4_t vMenor = vld1q_f32(v);
+		float32x4_t vMayor = vMenor;
+		for (k = 4; k + 4 <= n; k += 4){
+			float32x4_t x = vld1q_f32(v + k);
+			vMenor = vminq_f32(vMenor, x);
+			vMayor = vmaxq_f32(vMayor, x);
+		}
+		float a = vminvq_f32(vMenor), b = vmaxvq_f32(vMayor);
+		if (a < menor) menor = a;
+		if (b > mayor) mayor = b;
+	}
+	kernelLimitesEscalar(v + k, n - k, menor, mayor);
+}
+#endif
+
+/**
+* Devuelve el mejor kernel de limites disponible en esta maquina
+*/
+inline KernelLimites eligeKernelLimites(){
+#if defined(MAPGEN_X86)
+	static const KernelLimites elegido = cpuTieneAvx2() ? kernelLimitesAvx2 : kernelLimitesEscalar;
+	return elegido;
+#elif defined(MAPGEN_NEON)
+	return kernelLimitesNeon;
+#else
+	return kernelLimitesEscalar;
+#endif
+}
+
+/**
+* Devuelve el mejor kernel de fila disponible en esta maquina. La deteccion se hace solo la primera vez
+*/
+inline KernelFila eligeKernelFila(){
+#if defined(MAPGEN_X86)
+	static const KernelFila elegido = cpuTieneAvx2() ? kernelFilaAvx2 : kernelFilaEscalar;
+	return elegido;
+#elif defined(MAPGEN_NEON)
+	return kernelFilaNeon;
+#else
+	return kernelFilaEscalar;
+#endif
+}
+
+/**
+* Devuelve el mejor kernel de fila con offsets ya calculados disponible en esta maquina
+*/
+inline KernelFilaOffsets eligeKernelFilaOffsets(){
+#if defined(MAPGEN_X86)
+	static const KernelFilaOffsets elegido = cpuTieneAvx2() ? kernelFilaOffsetsAvx2 : kernelFilaOffsetsEscalar;
+	return elegido;
+#elif defined(MAPGEN_NEON)
+	return kernelFilaOffsetsNeon;
+#else
+	return kernelFilaOffsetsEscalar;
+#endif
+}
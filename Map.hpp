@@ -1,11 +1,88 @@
+#pragma once
+
 #include <iostream>
 #include <iomanip>
 #include <set>
+#include <unordered_map>
 #include <math.h>
 #include <time.h>
-#include <Windows.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <stdexcept>
+#include "FrameBuffer.hpp"
+#include "Kernels.hpp"
+#include "Rng.hpp"
+#include "HeightFile.hpp"
+#include "Samples.hpp"
+#include "Palette.hpp"
+#include "Stats.hpp"
+#include "Export.hpp"
+#include "Storage.hpp"
+
+/**
+* Una modificacion de un sector del mapa, con los mismos parametros que BasicMap::modificaSector() (para hacer muchas
+* de una vez, ver BasicMap::modificaSectores())
+*/
+struct EdicionSector {
+	int origX;
+	int origY;
+	int lado;
+	float roughness;
+	float centralHeight;
+};
+
+/**
+* Mapa de alturas generado con Diamond-Square. Sample es el tipo con el que se guarda cada altura (float, Half o
+* uint16_t, ver Samples.hpp): con los de 16 bits el mapa ocupa la mitad, a cambio de algo de precision. Rng es el
+* generador de numeros aleatorios (ver Rng.hpp) que usa el mapa para los offsets de generate(roughness); cada mapa
+* tiene el suyo. Alloc es el asignador con el que el mapa reserva su matriz de alturas (ver Storage.hpp); por defecto la
+* deja alineada a 64 bytes. Normalmente se usa a traves de Map (BasicMap<>).
+* Un mapa es el dueno de su matriz y la libera al destruirse: no se puede copiar, pero si mover (ver BasicMap(BasicMap&&))
+*/
+template <class Sample = float, class Rng = Xoshiro128Plus, class Alloc = AsignadorAlineado<Sample> >
+class BasicMap {
+public:
+
+	// TIPOS PUBLICOS
+
+	/**
+	* Un nivel de la piramide de detalle del mapa (ver getNivel()): lado x lado alturas, una de cada 'escala' casillas del
+	* mapa en cada direccion (el nivel 0 es el mapa entero, y en el ultimo solo quedan las cuatro esquinas).
+	* La altura (x,y) del nivel es alturas[x*paso + y*fila], en el tipo de muestra del mapa (ver getCuantizacion())
+	*/
+	struct Nivel {
+		const Sample *alturas;
+		int lado;
+		int escala;
+		int paso;
+		size_t fila;
+
+		const Sample& get(int x, int y) const {
+			return alturas[(size_t)x * paso + y * fila];
+		}
+	};
+
+	/**
+	* Recibe los niveles de la piramide de detalle segun se van terminando durante la generacion (ver
+	* setObservadorNiveles()), para poder ensenar algo antes de que termine
+	*/
+	class ObservadorNiveles {
+	public:
+		virtual ~ObservadorNiveles(){}
+
+		/**
+		* El nivel 'nivel' del mapa ya tiene sus alturas definitivas (y los mas bastos tambien). Se llama desde el hilo que
+		* genera, entre un nivel de la generacion y el siguiente, asi que el mapa no avanza hasta que vuelve. Ademas de
+		* leer el nivel (mapa.getNivel(nivel)) se puede pintar con mapa.mostrarNivel()
+		*/
+		virtual void nivelTerminado(BasicMap &mapa, int nivel) = 0;
+	};
 
-class Map {
 private:
 
 	// ATRIBUTOS DE LA LOGICA DEL MAPA
@@ -36,8 +113,17 @@ private:
 	* map es la matriz donde se guardan los valores de altura del terreno. Notese que no es un array bidimensional.
 	* Para acceder a la posicion (x,y) de la matriz (se puede acceder con el metodo get()), seria:
 	*	map[x + size*y];
+	* Las alturas se guardan como Sample; para leerlas o escribirlas en float hay que pasar por cuant (o por get() y set())
+	* Se usa como un Sample*, pero ademas es la duena de la memoria cuando la ha reservado el mapa (ver AlmacenAlturas en
+	* Storage.hpp): la libera al destruirse el mapa, y no la toca si es de un fichero o de otro mapa
+	*/
+	AlmacenAlturas<Sample, Alloc> map;
+
+	/*
+	* cuant pasa las alturas de float a Sample y al reves. Con uint16_t su rango se ajusta al empezar cada generacion
+	* (ver ajustaCuantizacion())
 	*/
-	float *map;
+	Cuantizacion<Sample> cuant;
 	
 	/*
 	* higher guardara, una vez generados los valores de altura del mapa, el valor mas alto de todo el mapa
@@ -53,6 +139,18 @@ private:
 	* guarda la seed con la que se ha generado el mapa
 	*/
 	int seed;
+
+	/*
+	* rng es el generador de numeros aleatorios propio del mapa, inicializado con seed. Al no ser global, varios mapas
+	* pueden generarse a la vez (o uno detras de otro) sin alterarse la secuencia entre ellos
+	*/
+	Rng rng;
+
+	/*
+	* archivo es el fichero proyectado en memoria sobre el que esta la matriz de alturas, si el mapa se ha construido sobre
+	* uno (ver BasicMap(HeightFile&)). Si es NULL, la matriz esta en memoria normal
+	*/
+	HeightFile *archivo;
 	
 
 	// ATRIBUTOS DE LA REPRESENTACION DEL MAPA
@@ -69,12 +167,102 @@ private:
 	* agua y altoMapa el mas bajo (sin agua);
 	*/
 	int alturaAgua;
+
+	/*
+	* paleta guarda el color de cada alto, para no calcularlo al representar (ver Palette.hpp). Salvo que se haya puesto
+	* una propia (paletaPropia), se vuelve a construir cada vez que cambian altoMapa o alturaAgua
+	*/
+	Paleta paleta;
+	bool paletaPropia;
 	
 
 	/*
-	* hdc es el handle de la ventana de salida (por defecto de la consola)
+	* lienzo es el framebuffer en memoria sobre el que pintan todos los metodos mostrar*
 	*/
-	HDC hdc;
+	FrameBuffer lienzo;
+
+	/*
+	* salida es el destino al que se vuelca el lienzo al terminar cada representacion (por defecto la ventana de la consola
+	* en Windows, y ninguno en el resto de sistemas). Si es NULL, la representacion solo queda en el lienzo.
+	*/
+	RenderSink *salida;
+
+	/*
+	* hilosRepresentacion es el numero de hilos con que se pintan las vistas (0 para usar todos los nucleos, ver
+	* setHilosRepresentacion())
+	*/
+	int hilosRepresentacion;
+
+	/*
+	* cubiertoCorte guarda, mientras se pinta una vista 3D completa, los pixeles ya pintados de su caja (ver
+	* pintaCorte3D()). Es del mapa para no reservarlo en cada representacion: solo crece, hasta la caja mas grande pintada
+	*/
+	std::vector<uint8_t> cubiertoCorte;
+
+	/*
+	* Rectangulo de casillas del mapa, de (x0,y0) a (x1,y1), ambas incluidas
+	*/
+	struct RectCasillas {
+		int x0, y0, x1, y1;
+	};
+
+	/*
+	* Representaciones que se pueden volver a pintar con actualizaVista()
+	*/
+	enum TipoVista {
+		VISTA_NINGUNA,
+		VISTA_PLANTA,
+		VISTA_CORTE,
+		VISTA_3DLR,
+		VISTA_3DRL,
+		VISTA_3DFRONT,
+		VISTA_3DLR_QUICK,
+		VISTA_3DRL_QUICK,
+		VISTA_3DFRONT_QUICK
+	};
+
+	/*
+	* Una representacion ya pintada en el lienzo: con que metodo y parametros, con que escala de alturas, y en que zona del
+	* lienzo puede haber pintado
+	*/
+	struct Vista {
+		TipoVista tipo;
+		int desdeX, desdeY;
+		int anchoPixel, altoPixel;	// en los cortes, los dos son el grosor
+		float higher, lower;
+		int x, y, ancho, alto;
+	};
+
+	/*
+	* vista es la ultima representacion mostrada, y sucios los sectores del mapa que han cambiado desde entonces (ver
+	* actualizaVista()). Con todoSucio ha cambiado el mapa entero, o la forma de colorearlo
+	*/
+	Vista vista;
+	std::vector<RectCasillas> sucios;
+	bool todoSucio;
+
+	/*
+	* piramide guarda, si conPiramide, una copia compacta de cada nivel de detalle a partir del 1 (el 0 es el propio mapa),
+	* para que las vistas de lejos lean pocas casillas seguidas en lugar de saltar por todo el mapa (ver getNivel())
+	*/
+	std::vector<std::vector<Sample> > piramide;
+	bool conPiramide;
+
+	/*
+	* observador recibe cada nivel segun se termina de generar (NULL si no hay). generando indica que hay una generacion
+	* a medias (higher y lower aun no valen)
+	*/
+	ObservadorNiveles *observador;
+	bool generando;
+
+#ifdef MAPGEN_STATS
+	/*
+	* estadisticas guarda lo medido en la ultima generacion y en las representaciones (ver Stats.hpp), y contadores
+	* apunta a los contadores del nivel que se esta generando (NULL fuera de la generacion)
+	*/
+	Estadisticas estadisticas;
+	ContadoresNivel *contadores;
+#endif
 	
 
 	// METODOS PRIVADOS
@@ -84,7 +272,7 @@ private:
 	*/
 	float get(int x, int y){
 		if (x < 0 || x > this->max || y < 0 || y > this->max) return -1;
-		return this->map[x + this->size * y];
+		return this->cuant.decodifica(this->map[x + this->size * y]);
 	}
 
 	/**
@@ -92,138 +280,731 @@ private:
 	*/
 	void set(int x, int y, float val){
 		if (x < 0 || x > this->max || y < 0 || y > this->max) return;
-		this->map[x + this->size * y] = val;
+		this->map[x + this->size * y] = this->cuant.codifica(val);
 	}
 
 	/**
-	* Calcula la media de 4 valores float (usado en diamantes y cuadrados).
-	* Si algun elemento del conjunto es -1 (por intentar hacer media con una posicion fuera de rango), este valor se descarta
-	* y se hace la media de el resto de valores validos.
-	* Devuelve la media
+	* Altura (en float) de la posicion i de la matriz, sin comprobar limites
 	*/
-	float average(float* values) {
-		float suma = 0;
-		int elementos = 0;
-		for (int i = 0; i < 3; ++i){
-			if (values[i] != -1){
-				suma += values[i];
-				++elementos;
+	float altura(int i) const {
+		return this->cuant.decodifica(this->map[i]);
+	}
+
+	/**
+	* Altura minima y maxima de un conjunto de casillas. Vacio (menor > mayor) mientras no se ha visto ninguna
+	*/
+	struct Limites {
+		float menor;
+		float mayor;
+
+		Limites(){
+			this->menor = HUGE_VALF;
+			this->mayor = -HUGE_VALF;
+		}
+
+		bool vacio() const {
+			return menor > mayor;
+		}
+
+		void junta(const Limites &otro){
+			if (otro.menor < menor) menor = otro.menor;
+			if (otro.mayor > mayor) mayor = otro.mayor;
+		}
+
+		void junta(float altura){
+			if (altura < menor) menor = altura;
+			if (altura > mayor) mayor = altura;
+		}
+	};
+
+	/**
+	* Amplia l con las n alturas de fila (con el kernel vectorial que toque en esta CPU)
+	*/
+	void limitesFila(const float *fila, int n, Limites &l) const {
+		eligeKernelLimites()(fila, n, l.menor, l.mayor);
+	}
+
+	/**
+	* Igual, para muestras cuantizadas
+	*/
+	template <class S>
+	void limitesFila(const S *fila, int n, Limites &l) const {
+		for (int i = 0; i < n; ++i){
+			float v = this->cuant.decodifica(fila[i]);
+			if (v < l.menor) l.menor = v;
+			if (v > l.mayor) l.mayor = v;
+		}
+	}
+
+	/**
+	* Limites de todo el mapa (o del sector, dentro de una VistaSector), recorriendolo entero
+	*/
+	Limites buscaLimites() const {
+		Limites l;
+		for (int y = 0; y <= this->max; ++y){
+			limitesFila(this->map + this->size * y, this->max + 1, l);
+		}
+		return l;
+	}
+
+	/**
+	* Establece higher y lower a partir de los limites recogidos durante la generacion (si no se ha recogido ninguno,
+	* p.ej. en un mapa de detalle 0 que no tiene niveles, se recorre el mapa)
+	*/
+	void fijaLimites(Limites l){
+		if (l.vacio()){
+			MAPGEN_STAT(long long t0 = relojNs();)
+			l = buscaLimites();
+			MAPGEN_STAT(this->estadisticas.nsLimites += relojNs() - t0;)
+		}
+		this->higher = l.mayor;
+		this->lower = l.menor;
+	}
+
+	/**
+	* Mientras existe, la generacion trabaja sobre un sector del mapa en vez de sobre el mapa entero, sin copiarlo: map
+	* apunta a la esquina del sector y max es su ultima casilla, pero las filas siguen separadas size casillas (las del
+	* mapa). Todo lo que recorre el mapa con map, size y max (divide(), divideSector(), buscaLimites(), get(), set()...)
+	* actua asi solo sobre el sector, que se ve como un mapa mas pequeno.
+	* El sector tiene su propio roughness y su propio generador, y sus niveles no se pasan al observador ni a la piramide.
+	* Al destruirse, el mapa vuelve a ser el de antes (y los niveles generados en el sector no quedan en las estadisticas)
+	*/
+	class VistaSector {
+	private:
+		BasicMap *mapa;
+		Sample *map;
+		int max;
+		float roughness;
+		Rng rng;
+		ObservadorNiveles *observador;
+		bool conPiramide;
+#ifdef MAPGEN_STATS
+		size_t niveles;
+		long long nsLimites;
+#endif
+
+	public:
+		VistaSector(BasicMap *mapa, int origX, int origY, int tam, float roughness, const Rng &rng) : rng(rng){
+			this->mapa = mapa;
+			this->map = mapa->map;
+			this->max = mapa->max;
+			this->roughness = mapa->roughness;
+			this->observador = mapa->observador;
+			this->conPiramide = mapa->conPiramide;
+			MAPGEN_STAT(this->niveles = mapa->estadisticas.niveles.size(); this->nsLimites = mapa->estadisticas.nsLimites;)
+			mapa->map = mapa->map + origX + (size_t)mapa->size * origY;
+			mapa->max = tam - 1;
+			mapa->roughness = roughness;
+			mapa->observador = NULL;		// los niveles del sector no son los del mapa
+			mapa->conPiramide = false;
+			std::swap(mapa->rng, this->rng);	// el del mapa se guarda aqui mientras tanto
+		}
+
+		~VistaSector(){
+			mapa->map = this->map;
+			mapa->max = this->max;
+			mapa->roughness = this->roughness;
+			mapa->observador = this->observador;
+			mapa->conPiramide = this->conPiramide;
+			std::swap(mapa->rng, this->rng);
+			MAPGEN_STAT(mapa->estadisticas.niveles.resize(this->niveles); mapa->estadisticas.nsLimites = this->nsLimites;)
+		}
+	};
+
+	/**
+	* Numero de niveles de la piramide de detalle: del 0 (el mapa) al que solo tiene las esquinas
+	*/
+	int numNiveles() const {
+		int niveles = 1;
+		while ((1 << (niveles - 1)) < this->max) ++niveles;
+		return niveles;
+	}
+
+	/**
+	* Copia en la piramide las casillas del nivel 'nivel' (1 o mas) que caen en el rectangulo (x0,y0)-(x1,y1) del mapa
+	*/
+	void copiaNivel(int nivel, int x0, int y0, int x1, int y1){
+		int escala = 1 << nivel;
+		int lado = this->max / escala + 1;
+		Sample *dst = &this->piramide[nivel][0];
+		for (int j = (y0 + escala - 1) / escala; j <= y1 / escala; ++j){
+			const Sample *fila = this->map + (size_t)this->size * j * escala;
+			for (int i = (x0 + escala - 1) / escala; i <= x1 / escala; ++i){
+				dst[i + (size_t)lado * j] = fila[i * escala];
 			}
 		}
-		return suma / elementos;
 	}
 
 	/**
-	* Realiza la media (cuadrado) de una posicion (x,y) mas un offset dado
+	* Las casillas del mapa de paso en paso ya tienen su altura definitiva: se copian a la piramide (si la hay) y se avisa
+	* al observador (si lo hay). Se llama al empezar divide() y despues de cada nivel
 	*/
-	void square(int x, int y, int size, float offset) {
-		float valores[4];
-		valores[0] = this->get(x - size, y - size);	  // upper left
-		valores[1] = this->get(x + size, y - size);   // upper right
-		valores[2] = this->get(x + size, y + size);	  // lower right
-		valores[3] = this->get(x - size, y + size);	  // lower left
-		float ave = average(valores);
-		this->set(x, y, ave + offset);
+	void nivelListo(int paso){
+		if (!this->conPiramide && this->observador == NULL) return;
+		int nivel = 0;
+		while ((1 << nivel) < paso) ++nivel;
+		if (this->conPiramide && nivel > 0) copiaNivel(nivel, 0, 0, this->max, this->max);
+		if (this->observador != NULL) this->observador->nivelTerminado(*this, nivel);
 	}
 
 	/**
-	* Realiza la media (diamante) de una posicion (x,y) mas un offset dado
+	* Despues de modificar el sector de tam x tam casillas con esquina en (x0,y0): se apunta para actualizaVista(), y se
+	* copia a la piramide
 	*/
-	void diamond(int x, int y, int size, float offset) {
-		float valores[4];
-		valores[0] = this->get(x, y - size);	// top
-		valores[1] = this->get(x + size, y);	// right
-		valores[2] = this->get(x, y + size);	// bottom
-		valores[3] = this->get(x - size, y);	// left
-		float ave = average(valores);
-		this->set(x, y, ave + offset);
+	void sectorModificado(int x0, int y0, int tam){
+		marcaSucio(x0, y0, tam);
+		if (this->conPiramide){
+			for (int nivel = 1; nivel < (int)this->piramide.size(); ++nivel){
+				copiaNivel(nivel, x0, y0, x0 + tam - 1, y0 + tam - 1);
+			}
+		}
 	}
 
+#ifdef MAPGEN_STATS
 	/**
-	* Rellena el mapa con los valores de altura, mediante el algoritmo Diamond-Square, de forma recursiva.
-	* Actua sobre TODOS los sectores cuadrados del mapa, de lado size. No confundir con this->size,
-	* aqui size cada vez es dos veces mas pequeo, actuando primero sobre un cuadrado de tamao
-	* size x size, luego size/2 x size/2, y asi recursivamente, hasta que el lado es 2, donde no se puede realizar
-	* ningun calculo mas
+	* Empieza a medir una generacion (se olvidan los niveles de la anterior)
 	*/
-	void divide(int size) {
-		int x, y, half = size / 2;
-		float scale = this->roughness * size;
-		/*
-		* scale tiene la funcion de darle "menos peso" a roughness cuanto mas pequea es la seccion a tratar.
-		* Esto evita que haya grandes diferecias de altura en casillas adyacentes, aun poniendo un roughness
-		* alto
+	void empiezaEstadisticas(){
+		this->estadisticas.inicioNs = relojNs();
+		this->estadisticas.nsGeneracion = 0;
+		this->estadisticas.nsLimites = 0;
+		this->estadisticas.niveles.clear();
+	}
+
+	/**
+	* Termina de medir una generacion
+	*/
+	void terminaEstadisticas(){
+		this->estadisticas.nsGeneracion = relojNs() - this->estadisticas.inicioNs;
+	}
+
+	/**
+	* Guarda lo medido en el nivel de lado 'lado', que empezo en el instante inicio, y deja de contar
+	*/
+	void cierraNivel(int lado, long long inicio){
+		EstadisticasNivel n;
+		n.lado = lado;
+		n.inicioNs = inicio;
+		n.ns = relojNs() - inicio;
+		n.nsSquare = this->contadores->nsSquare;
+		n.nsDiamond = this->contadores->nsDiamond;
+		n.casillasSquare = this->contadores->casillasSquare;
+		n.casillasDiamond = this->contadores->casillasDiamond;
+		n.bordes = this->contadores->bordes;
+		this->estadisticas.niveles.push_back(n);
+		this->estadisticas.nsLimites += this->contadores->nsLimites;
+		this->contadores = NULL;
+	}
+
+	/**
+	* Mide una representacion, desde que se crea hasta que se destruye (al salir del metodo mostrar* que la crea)
+	*/
+	class MedidaRepresentacion {
+	private:
+		BasicMap *mapa;
+		EstadisticasRepresentacion r;
+		long long escritosAntes;
+
+	public:
+		MedidaRepresentacion(BasicMap *mapa, const char *vista){
+			this->mapa = mapa;
+			this->r.vista = vista;
+			this->r.inicioNs = relojNs();
+			this->escritosAntes = mapa->lienzo.getPixelesEscritos();
+		}
+
+		~MedidaRepresentacion(){
+			this->r.ns = relojNs() - this->r.inicioNs;
+			this->r.pixeles = mapa->lienzo.getPixelesEscritos() - this->escritosAntes;
+			mapa->estadisticas.representaciones.push_back(this->r);
+		}
+	};
+#endif
+
+	/**
+	* Offsets aleatorios (entre -scale y scale) sacados del generador del mapa. Dependen del orden en que se recorren las
+	* casillas (no de su posicion, que se ignora), asi que solo sirven para generar de forma secuencial
+	*/
+	struct OffsetsRng {
+		Rng *rng;
+		float scale;
+		KernelFilaOffsets kernel;
+		Cuantizacion<Sample> cuant;
+
+		OffsetsRng(Rng *rng, float scale, const Cuantizacion<Sample> &cuant){
+			this->rng = rng;
+			this->scale = scale;
+			this->kernel = eligeKernelFilaOffsets();
+			this->cuant = cuant;
+		}
+
+		float operator()(int, int) const {
+			float r = rng->nextFloat();
+			return r * scale * 2 - scale;
+		}
+
+		/**
+		* Calcula una fila de medias de golpe (ver KernelFila en Kernels.hpp). Los valores aleatorios de la fila se piden
+		* al generador por bloques, con fill(), y se aplican en el mismo orden en que se recorren las casillas, con el
+		* kernel vectorial que toque en esta CPU
 		*/
-		if (half < 1) return;	// CASO BASE, cuando se tratan secciones de 2x2
+		void fila(float *dst, const float *t0, const float *t1, const float *t2, int n, int paso, int, int) const {
+			float r[256];
+			for (int k = 0, i = 0; k < n; k += 256, i += 256 * paso){
+				int bloque = (n - k < 256) ? n - k : 256;
+				rng->fill(r, bloque);
+				kernel(dst + i, t0 + i, t1 + i, t2 + i, bloque, paso, r, scale);
+			}
+		}
 
-		for (y = half; y < this->max; y += size) {
-			for (x = half; x < this->max; x += size) {
-				float r = ((float)rand() / (RAND_MAX));
-				square(x, y, half, r * scale * 2 - scale);
+		/**
+		* Igual, para muestras cuantizadas: las alturas se descuantizan, se calcula en float como en
+		* kernelFilaOffsetsEscalar(), y se vuelven a cuantizar al guardarlas
+		*/
+		template <class S>
+		void fila(S *dst, const S *t0, const S *t1, const S *t2, int n, int paso, int, int) const {
+			float r[256];
+			for (int k = 0, i = 0; k < n; ){
+				int bloque = (n - k < 256) ? n - k : 256;
+				rng->fill(r, bloque);
+				for (int j = 0; j < bloque; ++j, ++k, i += paso){
+					float media = (cuant.decodifica(t0[i]) + cuant.decodifica(t1[i]) + cuant.decodifica(t2[i])) / 3;
+					dst[i] = cuant.codifica(media + (r[j] * scale * 2 - scale));
+				}
 			}
 		}
-		/*
-		* Primero se calculan TODAS las medias (tipo square) para todas las subdivisiones de tamao size x size del mapa
-		* Estas medias establecen valores que son necesarios para calcular la medias tipo diamond
-		* No voy a explicar la forma de avance de los bucles for, porque no es trivial a simple vista.
-		* Notese que el ultimo valor pasado a la funcion square (offset), tiene un factor aleatorio (entre 0 y 1),
-		* que afecta a scale, permitiendo asi que la media calculada para una posicion pueda variar del valor exacto.
+	};
+
+	/**
+	* Offsets aleatorios (entre -scale y scale) que solo dependen de (seed, lado, x, y). Cada casilla recibe siempre el
+	* mismo offset, sin importar en que orden (o en que hilo) se calcule
+	*/
+	struct OffsetsHash {
+		uint32_t seed;
+		uint32_t lado;
+		float scale;
+		KernelFila kernel;
+		Cuantizacion<Sample> cuant;
+
+		OffsetsHash(uint32_t seed, int lado, float scale, const Cuantizacion<Sample> &cuant){
+			this->seed = seed;
+			this->lado = lado;
+			this->scale = scale;
+			this->kernel = eligeKernelFila();
+			this->cuant = cuant;
+		}
+
+		float operator()(int x, int y) const {
+			float r = hashToFloat(hashCelda(seed, lado, x, y));
+			return r * scale * 2 - scale;
+		}
+
+		/**
+		* Calcula una fila de medias de golpe con el kernel vectorial que toque en esta CPU
+		*/
+		void fila(float *dst, const float *t0, const float *t1, const float *t2, int n, int paso, int x0, int y) const {
+			kernel(dst, t0, t1, t2, n, paso, x0, hashFila(seed, lado, y), scale);
+		}
+
+		/**
+		* Igual, para muestras cuantizadas: las alturas se descuantizan, se calcula en float como en kernelFilaEscalar(),
+		* y se vuelven a cuantizar al guardarlas
 		*/
-		for (y = 0; y <= this->max; y += half) {
-			for (x = (y + half) % size; x <= this->max; x += size) {
-				float r = ((float)rand() / (RAND_MAX));
-				diamond(x, y, half, r * scale * 2 - scale);
+		template <class S>
+		void fila(S *dst, const S *t0, const S *t1, const S *t2, int n, int paso, int x0, int y) const {
+			uint32_t hFila = hashFila(seed, lado, y);
+			for (int k = 0, i = 0; k < n; ++k, i += paso){
+				float r = hashToFloat(hashCelda(hFila, x0 + i));
+				float media = (cuant.decodifica(t0[i]) + cuant.decodifica(t1[i]) + cuant.decodifica(t2[i])) / 3;
+				dst[i] = cuant.codifica(media + (r * scale * 2 - scale));
 			}
 		}
-		/*
-		* Despues se calculan TODAS las medias (tipo diamond), para los puntos medios de los lados del la subdivision de 
-		* tamao size x size, esto es:
-		*
-		*	o-------=-------o		o---=---o---=---o			Los simbolos = y ! marcan las casillas sobre las que se 
-		*	|       |       |		|   |   |   |   |			calculara la media diamond para la llamada actual
-		*	|       |       |		!---X---!---X---!			Considerando los puntos o como casillas con valor de
-		*	|       |       |		|   |   |   |   |			altura calculado
-		*	!-------X-------!  -->	o---=---o---=---o			Los simbolos X son las casillas sobre las que se calculara
-		*	|       |       |		|   |   |   |   |			la media square para la llamada actual
-		*	|       |       |		!---X---!---X---!
-		*	|       |       |		|   |   |   |   |
-		*	o-------=-------o		o---=---o---=---o
-		*
-		* Siendo este el mapa, de tamao (17 x 17) (se incluyen los puntos o), se estarian, en esta fase, calculando las medias
-		* Para cuadrados  de (8 x 8), ya que la primera llamada a divide() se hace con el valor this->max, no con size (porque es
-		* impar).
-		* Si se sigue el algoritmo, se vera que para esta llamada inicial, solo se calcula el valor de la casilla marcada con X
-		* (una media de tipo square), y luego se pasa a calcular las medias de los puntos marcados con = y !, tras hacerlo,
-		* se llama a divide con size/2, y como se puede ver en el cuadrado de la derecha, los valores para las esquinas de cada
-		* cuadrado de tamao size/2 ya estan calculadas por la llamada anterior (representados con o)
+	};
+
+	/**
+	* Alturas sueltas de un mapa generado con generate(roughness, threads), sin generar el mapa.
+	* Con OffsetsHash la altura de una casilla solo depende de sus vecinos de la media (square o diamond) y de su offset,
+	* que sale de (seed, lado, x, y): se calcula hacia atras, pidiendo solo los vecinos que hacen falta hasta llegar a las
+	* esquinas del mapa. Cada casilla calculada se guarda, asi que una casilla pide como mucho unas pocas casillas por
+	* nivel (O(detail) en total), y las consultas cercanas comparten casi todas las suyas.
+	* Las cuentas son las mismas, en el mismo orden, que las de divideHash(), asi que el resultado es identico bit a bit
+	*/
+	class ConoAlturas {
+	private:
+		uint32_t seed;
+		float roughness;
+		int max;
+		Cuantizacion<Sample> cuant;
+		std::unordered_map<uint64_t, float> calculadas;
+
+	public:
+		ConoAlturas(int seed, float roughness, int detail){
+			this->seed = seed;
+			this->roughness = roughness;
+			this->max = 1 << detail;
+			ajustaCuantizacion(this->cuant, this->max, roughness);
+			calculadas.reserve(8 * detail + 8);		// lo que necesita una consulta sola
+		}
+
+		/**
+		* Altura de la casilla (x,y), que tiene que estar dentro del mapa
 		*/
+		float altura(int x, int y){
+			if ((x == 0 || x == this->max) && (y == 0 || y == this->max)){
+				return cuant.decodifica(cuant.codifica(this->max * 3 / 4));	// esquina, como en generate()
+			}
+			uint64_t clave = ((uint64_t)(uint32_t)y << 32) | (uint32_t)x;
+			typename std::unordered_map<uint64_t, float>::iterator it = calculadas.find(clave);
+			if (it != calculadas.end()) return it->second;
+
+			// El nivel de la casilla es el del bit mas bajo de x o y: half = lado/2
+			int half = (x | y) & -(x | y);
+			int lado = 2 * half;
+			float scale = this->roughness * lado;
+			float suma;
+			int elementos;
+			if ((x & half) && (y & half)){
+				// square: esquinas de arriba-izquierda, arriba-derecha y abajo-derecha (ver squareFilas())
+				suma = altura(x - half, y - half) + altura(x + half, y - half) + altura(x + half, y + half);
+				elementos = 3;
+			}
+			else {
+				// diamond: arriba, derecha y abajo, los que caigan dentro del mapa (ver diamondBorde())
+				suma = 0;
+				elementos = 0;
+				if (y - half >= 0){
+					suma += altura(x, y - half);
+					++elementos;
+				}
+				if (x + half <= this->max){
+					suma += altura(x + half, y);
+					++elementos;
+				}
+				if (y + half <= this->max){
+					suma += altura(x, y + half);
+					++elementos;
+				}
+			}
+			float r = hashToFloat(hashCelda(this->seed, lado, x, y));
+			float valor = cuant.decodifica(cuant.codifica(suma / elementos + (r * scale * 2 - scale)));
+			calculadas[clave] = valor;
+			return valor;
+		}
+	};
+
+	/**
+	* Realiza la media (diamante) de una posicion (x,y) del borde del mapa mas un offset dado.
+	* Solo se hace la media de los vecinos que caen dentro del mapa.
+	* Igual que en todo el algoritmo, se usan los vecinos de arriba, derecha y abajo (el de la izquierda nunca ha
+	* entrado en la media), para que una misma semilla siga generando el mismo mapa.
+	*/
+	void diamondBorde(int x, int y, int half, float offset) {
+		float suma = 0;
+		int elementos = 0;
+		if (y - half >= 0){					// top
+			suma += altura(x + this->size * (y - half));
+			++elementos;
+		}
+		if (x + half <= this->max){			// right
+			suma += altura((x + half) + this->size * y);
+			++elementos;
+		}
+		if (y + half <= this->max){			// bottom
+			suma += altura(x + this->size * (y + half));
+			++elementos;
+		}
+		this->map[x + this->size * y] = this->cuant.codifica(suma / elementos + offset);
+	}
+
+	/**
+	* Calcula las medias de tipo square de las filas de centros [desde, hasta) para las subdivisiones de lado 'lado'
+	* (la fila de centros k es la fila y = lado/2 + k*lado del mapa).
+	* Los centros de los cuadrados nunca estan en el borde, asi que sus vecinos siempre son validos y se accede
+	* directamente a las filas de arriba y abajo, sin comprobar limites.
+	* Se usan las esquinas de arriba-izquierda, arriba-derecha y abajo-derecha.
+	*/
+	template <class Offsets>
+	void squareFilas(int lado, int desde, int hasta, const Offsets &offsets) {
+		int half = lado / 2;
+		for (int y = half + desde * lado; y < half + hasta * lado; y += lado) {
+			Sample *fila = this->map + this->size * y;
+			const Sample *arriba = fila - this->size * half;
+			const Sample *abajo = fila + this->size * half;
+			// Para x = half, half + lado, ...: arriba[x - half], arriba[x + half] y abajo[x + half]
+			offsets.fila(fila + half, arriba, arriba + lado, abajo + lado, this->max / lado, lado, half, y);
+			MAPGEN_STAT(if (this->contadores != NULL) this->contadores->casillasSquare += this->max / lado;)
+		}
+	}
+
+	/**
+	* Calcula las medias de tipo diamond de las filas [desde, hasta) para las subdivisiones de lado 'lado'
+	* (la fila k es la fila y = k*lado/2 del mapa).
+	* Solo las filas primera y ultima, y la ultima casilla de cada fila, tienen vecinos fuera del mapa: esas pasan por
+	* diamondBorde(), el resto se calcula directamente con los vecinos de arriba, derecha y abajo.
+	* Con bordesFijos, las casillas del borde del mapa no se tocan (ya vienen calculadas, ver generateTile()).
+	* Si se pasa limites, se amplian con cada fila recien calculada. Solo tiene sentido en el ultimo nivel (lado 2), que
+	* pasa por todas las filas y las deja terminadas: asi se sacan higher y lower sin volver a recorrer el mapa
+	*/
+	template <class Offsets>
+	void diamondFilas(int lado, int desde, int hasta, const Offsets &offsets, bool bordesFijos = false,
+		Limites *limites = NULL) {
+		int half = lado / 2;
+		for (int y = desde * half; y < hasta * half; y += half) {
+			diamondFila(lado, y, offsets, bordesFijos);
+			if (limites != NULL){
+				MAPGEN_STAT(long long t0 = relojNs();)
+				limitesFila(this->map + this->size * y, this->max + 1, *limites);
+				MAPGEN_STAT(if (this->contadores != NULL) this->contadores->nsLimites += relojNs() - t0;)
+			}
+		}
+	}
+
+	/**
+	* Calcula las medias de tipo diamond de la fila y del mapa (ver diamondFilas())
+	*/
+	template <class Offsets>
+	void diamondFila(int lado, int y, const Offsets &offsets, bool bordesFijos) {
+		int half = lado / 2;
+		int x = (y + half) % lado;
+		if (bordesFijos){
+			if (y == 0 || y == this->max) return;
+			if (x == 0) x = lado;
+		}
+		if (y == 0 || y == this->max){
+			MAPGEN_STAT(int x0 = x;)
+			for (; x <= this->max; x += lado) {
+				diamondBorde(x, y, half, offsets(x, y));
+			}
+			MAPGEN_STAT(if (this->contadores != NULL){
+				this->contadores->casillasDiamond += (x - x0) / lado;
+				this->contadores->bordes += (x - x0) / lado;
+			})
+			return;
+		}
+		Sample *fila = this->map + this->size * y;
+		const Sample *arriba = fila - this->size * half;
+		const Sample *abajo = fila + this->size * half;
+		// Para x = x0, x0 + lado, ... (sin llegar a max): arriba[x], fila[x + half] y abajo[x]
+		int n = (this->max - x + lado - 1) / lado;
+		offsets.fila(fila + x, arriba + x, fila + x + half, abajo + x, n, lado, x, y);
+		MAPGEN_STAT(if (this->contadores != NULL) this->contadores->casillasDiamond += n;)
+		x += n * lado;
+		if (x == this->max && !bordesFijos){
+			diamondBorde(x, y, half, offsets(x, y));
+			MAPGEN_STAT(if (this->contadores != NULL){
+				++this->contadores->casillasDiamond;
+				++this->contadores->bordes;
+			})
+		}
+	}
+
+	/**
+	* Calcula TODAS las medias de tipo square para las subdivisiones de lado 'lado' del mapa
+	*/
+	void squarePass(int lado, float scale) {
+		squareFilas(lado, 0, this->max / lado, OffsetsRng(&this->rng, scale, this->cuant));
+	}
+
+	/**
+	* Calcula TODAS las medias de tipo diamond para las subdivisiones de lado 'lado' del mapa.
+	* Las casillas se recorren en el mismo orden que antes, para que los valores aleatorios caigan en las mismas casillas.
+	*/
+	void diamondPass(int lado, float scale, Limites *limites = NULL) {
+		diamondFilas(lado, 0, 2 * (this->max / lado) + 1, OffsetsRng(&this->rng, scale, this->cuant), false, limites);
+	}
+
+	/**
+	* Reparte las filas [0, filas) en bloques consecutivos entre varios hilos, y llama a trabajo(desde, hasta) con cada
+	* bloque. El hilo que llama se queda con el primero. No se lanzan mas hilos de los que merece la pena para el numero
+	* de casillas a tratar (casillasPorFila * filas)
+	*/
+	template <class Trabajo>
+	static void enParalelo(int filas, int casillasPorFila, int hilos, const Trabajo &trabajo){
+		int maxHilos = 1 + (int)(((long long)filas * casillasPorFila) / 16384);
+		if (hilos > maxHilos) hilos = maxHilos;
+		if (hilos > filas) hilos = filas;
+		if (hilos <= 1){
+			trabajo(0, filas);
+			return;
+		}
+		std::vector<std::thread> lanzados;
+		for (int i = 1; i < hilos; ++i){
+			lanzados.push_back(std::thread(trabajo, (int)((long long)filas * i / hilos), (int)((long long)filas * (i + 1) / hilos)));
+		}
+		trabajo(0, filas / hilos);
+		for (size_t i = 0; i < lanzados.size(); ++i){
+			lanzados[i].join();
+		}
+	}
+
+	/**
+	* Hilos con los que se pintan las vistas (ver setHilosRepresentacion())
+	*/
+	int hilosVista() const {
+		int hilos = this->hilosRepresentacion;
+		if (hilos <= 0) hilos = std::thread::hardware_concurrency();
+		return (hilos < 1) ? 1 : hilos;
+	}
+
+	/**
+	* Rellena el mapa con los valores de altura, mediante el algoritmo Diamond-Square.
+	* Actua sobre TODOS los sectores cuadrados del mapa, de lado size. No confundir con this->size,
+	* aqui el lado cada vez es dos veces mas pequeo, actuando primero sobre un cuadrado de tamao
+	* size x size, luego size/2 x size/2, y asi sucesivamente (un nivel por vuelta del bucle), hasta que el lado es 2,
+	* donde no se puede realizar ningun calculo mas.
+	* En el ultimo nivel se recogen en limites la altura minima y maxima del mapa (ver diamondFilas())
+	*/
+	void divide(int size, Limites *limites = NULL) {
+		nivelListo(size);		// las esquinas de los cuadrados de lado size ya estan
+		for (int lado = size; lado / 2 >= 1; lado /= 2) {
+			float scale = this->roughness * lado;
+			/*
+			* scale tiene la funcion de darle "menos peso" a roughness cuanto mas pequea es la seccion a tratar.
+			* Esto evita que haya grandes diferecias de altura en casillas adyacentes, aun poniendo un roughness
+			* alto
+			*/
+
+			MAPGEN_STAT(ContadoresNivel contadoresNivel; this->contadores = &contadoresNivel; long long t0 = relojNs();)
+			squarePass(lado, scale);
+			MAPGEN_STAT(long long t1 = relojNs(); contadoresNivel.nsSquare += t1 - t0;)
+			/*
+			* Primero se calculan TODAS las medias (tipo square) para todas las subdivisiones de tamao size x size del mapa
+			* Estas medias establecen valores que son necesarios para calcular la medias tipo diamond
+			* No voy a explicar la forma de avance de los bucles for, porque no es trivial a simple vista.
+			* Notese que el ultimo valor pasado a la funcion square (offset), tiene un factor aleatorio (entre 0 y 1),
+			* que afecta a scale, permitiendo asi que la media calculada para una posicion pueda variar del valor exacto.
+			*/
+			diamondPass(lado, scale, (lado == 2) ? limites : NULL);
+			/*
+			* Despues se calculan TODAS las medias (tipo diamond), para los puntos medios de los lados del la subdivision de 
+			* tamao size x size, esto es:
+			*
+			*	o-------=-------o		o---=---o---=---o			Los simbolos = y ! marcan las casillas sobre las que se 
+			*	|       |       |		|   |   |   |   |			calculara la media diamond para la llamada actual
+			*	|       |       |		!---X---!---X---!			Considerando los puntos o como casillas con valor de
+			*	|       |       |		|   |   |   |   |			altura calculado
+			*	!-------X-------!  -->	o---=---o---=---o			Los simbolos X son las casillas sobre las que se calculara
+			*	|       |       |		|   |   |   |   |			la media square para la llamada actual
+			*	|       |       |		!---X---!---X---!
+			*	|       |       |		|   |   |   |   |
+			*	o-------=-------o		o---=---o---=---o
+			*
+			* Siendo este el mapa, de tamao (17 x 17) (se incluyen los puntos o), se estarian, en esta fase, calculando las medias
+			* Para cuadrados  de (8 x 8), ya que la primera llamada a divide() se hace con el valor this->max, no con size (porque es
+			* impar).
+			* Si se sigue el algoritmo, se vera que para esta llamada inicial, solo se calcula el valor de la casilla marcada con X
+			* (una media de tipo square), y luego se pasa a calcular las medias de los puntos marcados con = y !, tras hacerlo,
+			* se llama a divide con size/2, y como se puede ver en el cuadrado de la derecha, los valores para las esquinas de cada
+			* cuadrado de tamao size/2 ya estan calculadas por la llamada anterior (representados con o)
+			*/
+			MAPGEN_STAT(contadoresNivel.nsDiamond += relojNs() - t1;)
+			MAPGEN_STAT(cierraNivel(lado, t0);)
+			nivelListo(lado / 2);
+		}
+	}
+
+	/**
+	* Igual que divide(), pero con los offsets de OffsetsHash en vez de los del generador del mapa. Como el offset de cada
+	* casilla no depende del orden de calculo, cada nivel se reparte por bloques de filas entre 'hilos' hilos, y el
+	* resultado es exactamente el mismo con cualquier numero de hilos.
+	* Con bordesFijos no se recalculan las casillas del borde del mapa.
+	* Igual que en divide(), en el ultimo nivel se recogen en limites la altura minima y maxima del mapa
+	*/
+	void divideHash(int size, int hilos, bool bordesFijos = false, Limites *limites = NULL) {
+		std::mutex cerrojo;
+		nivelListo(size);
+		for (int lado = size; lado / 2 >= 1; lado /= 2) {
+			float scale = this->roughness * lado;
+			OffsetsHash offsets(this->seed, lado, scale, this->cuant);
+			Limites *limitesNivel = (lado == 2) ? limites : NULL;
+			int centros = this->max / lado;		// filas de centros (square) del nivel
+			MAPGEN_STAT(ContadoresNivel contadoresNivel; this->contadores = &contadoresNivel; long long t0 = relojNs();)
+			std::vector<char> pendientes(centros + 1, 0);
+			pendientes[centros] = 1;
+			/*
+			* En vez de hacer todas las square y luego todas las diamond (dos recorridos del mapa por nivel), cada hilo
+			* avanza por su bloque de filas de centros [desde, hasta) haciendo, para cada fila de centros m, sus square, las
+			* diamond de esa misma fila (fila 2m+1 de diamonds) y las de la fila de encima (fila 2m), que ya tiene calculados
+			* los centros de arriba y abajo. Asi cada nivel se recorre una sola vez, y las filas que se tocan estan siempre
+			* cerca unas de otras, lo que importa mucho cuando el mapa no cabe en memoria (ver HeightFile).
+			* La fila 2*desde necesita la ultima fila de centros del bloque anterior, asi que se deja para el final, junto
+			* con la ultima fila del mapa.
+			*/
+			enParalelo(centros, centros + 1, hilos, [&](int desde, int hasta){
+				Limites propios;	// cada hilo recoge los suyos, y al terminar se juntan
+				Limites *l = (limitesNivel != NULL) ? &propios : NULL;
+				MAPGEN_STAT(long long nsSquare = 0, nsDiamond = 0;)
+				for (int m = desde; m < hasta; ++m) {
+					MAPGEN_STAT(long long t1 = relojNs();)
+					squareFilas(lado, m, m + 1, offsets);
+					MAPGEN_STAT(long long t2 = relojNs(); nsSquare += t2 - t1;)
+					diamondFilas(lado, 2 * m + 1, 2 * m + 2, offsets, bordesFijos, l);
+					if (m > desde) diamondFilas(lado, 2 * m, 2 * m + 1, offsets, bordesFijos, l);
+					MAPGEN_STAT(nsDiamond += relojNs() - t2;)
+				}
+				MAPGEN_STAT(contadoresNivel.nsSquare += nsSquare; contadoresNivel.nsDiamond += nsDiamond;)
+				pendientes[desde] = 1;
+				if (l != NULL){
+					std::lock_guard<std::mutex> bloqueo(cerrojo);
+					limitesNivel->junta(propios);
+				}
+			});
+			MAPGEN_STAT(long long t1 = relojNs();)
+			for (int m = 0; m <= centros; ++m) {
+				if (pendientes[m]) diamondFilas(lado, 2 * m, 2 * m + 1, offsets, bordesFijos, limitesNivel);
+			}
+			MAPGEN_STAT(contadoresNivel.nsDiamond += relojNs() - t1;)
+			MAPGEN_STAT(cierraNivel(lado, t0);)
+			nivelListo(lado / 2);
+		}
+	}
+
+	/**
+	* Devuelve el offset aleatorio (entre -scale y scale) de la casilla global (gx, gy) de un mundo hecho de tiles.
+	* Solo depende de la semilla del mundo y de las coordenadas globales, asi que dos tiles vecinos que comparten una
+	* casilla (en sus bordes) le dan el mismo valor
+	*/
+	static float offsetGlobal(uint32_t worldSeed, uint32_t lado, uint32_t gx, uint32_t gy, float scale) {
+		float r = hashToFloat(hashCelda(worldSeed, lado, gx, gy));
+		return r * scale * 2 - scale;
+	}
 
-		divide(size / 2);
+	/**
+	* Rellena un borde del tile (fila o columna, desde la casilla (x0,y0) avanzando (dx,dy)) con Midpoint Displacement en
+	* una dimension: cada punto medio es la media de sus dos extremos mas un offset global.
+	* El borde solo depende de sus dos esquinas y de las coordenadas globales, que son las mismas para los dos tiles que
+	* lo comparten, asi que ambos lo generan igual y encajan sin costuras
+	*/
+	void bordeTile(uint32_t worldSeed, uint32_t gx0, uint32_t gy0, int x0, int y0, int dx, int dy) {
+		for (int lado = this->max; lado / 2 >= 1; lado /= 2) {
+			int half = lado / 2;
+			float scale = this->roughness * lado;
+			for (int i = half; i < this->max; i += lado) {
+				int x = x0 + dx * i, y = y0 + dy * i;
+				float a = altura((x - dx * half) + this->size * (y - dy * half));
+				float b = altura((x + dx * half) + this->size * (y + dy * half));
+				this->set(x, y, (a + b) / 2 + offsetGlobal(worldSeed, lado, gx0 + x, gy0 + y, scale));
+			}
+		}
 	}
 
 	/**
 	* Se puede considerar una excepcion de divide(), se usa cuando se modifica un sector del mapa, se llama en generateSector()
 	* donde se puede establecer la altura base del punto central, que influye en todas el terreno colindante.
-	* Para esta primera llamada a divide() (la cual es divideSector), no se calcula la media para el punto medio del sector,
+	* Para el primer nivel (el de lado size), no se calcula la media para el punto medio del sector,
 	* sino que se establece directamente al valor centralHeight, para el resto de puntos del sector, se sigue el algoritmo
 	* normal de divide
-	*
-	* NO ES UNA FUNCION RECURSIVA, pero si que llama a divide, que si lo es
 	*/
-	void divideSector(int size, float centralHeight) {
-		int x, y, half = size / 2;
+	void divideSector(int size, float centralHeight, Limites *limites = NULL) {
+		int half = size / 2;
 		float scale = this->roughness * size;
 		if (half < 1) return;	// por si se tratan secciones de 2x2
 	
+		nivelListo(size);
 		this->set(half, half, centralHeight);	// La PRIMERA vez no se calcula una media square, se pone directamente este valor
 
-		for (y = 0; y <= this->max; y += half) {
-			for (x = (y + half) % size; x <= this->max; x += size) {
-				float r = ((float)rand() / (RAND_MAX));
-				diamond(x, y, half, r * scale * 2 - scale);
-			}
-		}
-		divide(size / 2);	// Notese que la llamada es a divide, y no a divideSector()
+		diamondPass(size, scale, (size == 2) ? limites : NULL);
+		divide(size / 2, limites);	// Notese que la llamada es a divide, y no a divideSector()
 	}
 
 	/**
@@ -233,7 +1014,405 @@ private:
 	*/
 	int calculaAlto(float n){
 		int tamRangoAlturas = higher - lower;	// El rango de alturas siempre sera higher-lower, incluso si lower < 0
-		return (tamRangoAlturas == 0) ? 200 : (n - lower) * 200 / tamRangoAlturas;
+		return (tamRangoAlturas == 0) ? altoMapa : (n - lower) * altoMapa / tamRangoAlturas;
+	}
+
+	/**
+	* Calcula de una vez el alto (igual que calculaAlto()) de las casillas [desde, hasta) de la fila y del mapa, y lo deja
+	* en altos[desde, hasta)
+	*/
+	void altosFila(int y, int desde, int hasta, int *altos){
+		int tamRangoAlturas = higher - lower;
+		const Sample *fila = this->map + this->size * y;
+		if (tamRangoAlturas == 0){
+			for (int x = desde; x < hasta; ++x) altos[x] = altoMapa;
+			return;
+		}
+		for (int x = desde; x < hasta; ++x){
+			altos[x] = (this->cuant.decodifica(fila[x]) - lower) * altoMapa / tamRangoAlturas;
+		}
+	}
+
+	/**
+	* Como altosFila(), pero de la fila y del nivel n de la piramide de detalle (ver getNivel())
+	*/
+	void altosNivel(const Nivel &n, int y, int desde, int hasta, int *altos){
+		int tamRangoAlturas = higher - lower;
+		const Sample *fila = n.alturas + n.fila * y;
+		if (tamRangoAlturas == 0){
+			for (int x = desde; x < hasta; ++x) altos[x] = altoMapa;
+			return;
+		}
+		for (int x = desde; x < hasta; ++x){
+			altos[x] = (this->cuant.decodifica(fila[(size_t)x * n.paso]) - lower) * altoMapa / tamRangoAlturas;
+		}
+	}
+
+	/**
+	* Recorta el rectangulo de casillas (x0, y0, ancho, alto) a los limites del mapa. Devuelve false si no queda nada
+	*/
+	bool recortaRect(int &x0, int &y0, int &ancho, int &alto) const {
+		int x1 = (x0 + ancho < this->size) ? x0 + ancho : this->size;
+		int y1 = (y0 + alto < this->size) ? y0 + alto : this->size;
+		if (x0 < 0) x0 = 0;
+		if (y0 < 0) y0 = 0;
+		ancho = x1 - x0;
+		alto = y1 - y0;
+		return ancho > 0 && alto > 0;
+	}
+
+	/**
+	* Division entera redondeando hacia abajo (tambien con a negativo)
+	*/
+	static int divAbajo(int a, int b){
+		return (a >= 0) ? a / b : -((-a + b - 1) / b);
+	}
+
+	/**
+	* Para una fila del mapa que se pinta entre las filas [y0, y0 + alto) del lienzo, y cuya casilla i se pinta en las
+	* columnas [x0 + i*paso, x0 + (i+1)*paso), devuelve en [desde, hasta) las casillas que caen dentro del recorte del
+	* lienzo (todas si no hay recorte, ver actualizaVista()). Devuelve false si no cae ninguna
+	*/
+	bool celdasVisibles(int y0, int alto, int x0, int paso, int &desde, int &hasta) const {
+		desde = 0;
+		hasta = this->size;
+		int rx0, ry0, rx1, ry1;
+		if (!lienzo.getRecorte(rx0, ry0, rx1, ry1) || paso <= 0) return true;
+		if (y0 >= ry1 || y0 + alto <= ry0) return false;
+		// x0 + (i+1)*paso > rx0  y  x0 + i*paso < rx1
+		int primera = divAbajo(rx0 - x0, paso);
+		int ultima = divAbajo(rx1 - x0 - 1, paso);
+		if (primera > desde) desde = primera;
+		if (ultima + 1 < hasta) hasta = ultima + 1;
+		return desde < hasta;
+	}
+
+	/*
+	* Una franja de columnas del lienzo que pinta un hilo en pintaCorte3D(): la caja (x, y, ancho, alto) en la que pinta,
+	* y por cada columna su horizonte y los pixeles ya pintados (cubierto, por filas: su trozo de cubiertoCorte)
+	*/
+	struct FranjaCorte {
+		int x, y, ancho, alto;
+		std::vector<int> horizonte;
+		uint8_t *cubierto;
+		long long escritos;
+	};
+
+	/**
+	* Pinta la columna x del lienzo entre las filas [ya, yb), salvo los pixeles que ya esten apuntados en f.cubierto, y
+	* los apunta. No pinta fuera de la caja de la franja
+	*/
+	void pintaTramo(FranjaCorte &f, int x, int ya, int yb, COLORREF color){
+		if (ya < f.y) ya = f.y;
+		if (yb > f.y + f.alto) yb = f.y + f.alto;
+		uint8_t *p = f.cubierto + (x - f.x);
+		for (int y = ya; y < yb; ++y){
+			uint8_t &pintado = p[(size_t)(y - f.y) * f.ancho];
+			if (!pintado){
+				pintado = 1;
+				lienzo.ponPixel(x, y, color);
+				++f.escritos;
+			}
+		}
+	}
+
+	/**
+	* Pinta las vistas 3D completas (mostrarCorte3DLR(), mostrarCorte3DRL() y mostrarCorte3DFront()): la fila y del mapa
+	* se pinta y pixeles mas abajo, con su casilla i en las columnas [x0 + dx*y + i*grosor, x0 + dx*y + (i+1)*grosor).
+	* Las filas y casillas son las del nivel n de la piramide de detalle (el 0 para el mapa entero, ver getNivel()).
+	* Queda igual que pintando las filas de atras a delante, cada una encima de las anteriores, pero se pintan de delante
+	* a atras y cada pixel se escribe una sola vez:
+	*	- horizonte guarda, por cada columna del lienzo, el tope mas alto de las columnas de casilla ya pintadas. La de la
+	*	  fila y acaba en altoMapa + y, antes que todas las de delante, asi que lo que quede entre el horizonte y ese fondo
+	*	  ya esta tapado: solo se pinta lo que asoma por encima del horizonte (nada, si la casilla queda detras entera)
+	*	- cubierto apunta los pixeles ya pintados, para los que quedan sueltos fuera de ese tramo: el agua, que va por
+	*	  encima de la columna, y las lineas de nivel de las casillas sin columna (alto >= altoMapa)
+	* Solo se pinta dentro del recorte del lienzo, y solo se leen las casillas que caen dentro.
+	* Como lo que se pinta en una columna del lienzo solo depende de su horizonte y sus pixeles, las columnas se
+	* reparten en franjas entre los hilos de representacion (ver setHilosRepresentacion()), sin pisarse entre ellos
+	*/
+	void pintaCorte3D(const Nivel &n, int desdeY, int x0, int dx, int grosor, COLORREF c){
+		if (grosor <= 0) return;
+		int bx, by, bw, bh;
+		if (!cajaCorte3D(n, desdeY, x0, dx, grosor, bx, by, bw, bh)) return;
+		// cada franja usa (y limpia) su propio trozo de cubiertoCorte, el de sus columnas
+		size_t pixelesCaja = (size_t)bw * bh;
+		if (this->cubiertoCorte.size() < pixelesCaja) this->cubiertoCorte.resize(pixelesCaja);
+		std::atomic<long long> escritos(0);
+		enParalelo(bw, n.lado, hilosVista(), [&](int desde, int hasta){
+			FranjaCorte f;
+			f.x = bx + desde;
+			f.y = by;
+			f.ancho = hasta - desde;
+			f.alto = bh;
+			f.horizonte.assign(f.ancho, 0x7FFFFFFF);
+			f.cubierto = &this->cubiertoCorte[(size_t)desde * bh];
+			std::fill(f.cubierto, f.cubierto + (size_t)f.ancho * f.alto, 0);
+			f.escritos = 0;
+			pintaFranja3D(n, desdeY, x0, dx, grosor, c, f);
+			escritos += f.escritos;
+		});
+		lienzo.cuentaEscritos(escritos);
+	}
+
+	/**
+	* La caja del lienzo en la que pintan las vistas 3D del nivel n (ver pintaCorte3D()), sin recortar
+	*/
+	void extensionCorte3D(const Nivel &n, int desdeY, int x0, int dx, int grosor, int &bx, int &by, int &bw, int &bh) const {
+		int ultimaFila = n.lado - 1;
+		bx = (dx < 0) ? x0 + dx * ultimaFila : x0;
+		by = desdeY;
+		bw = grosor * n.lado + ((dx != 0) ? ultimaFila : 0);
+		bh = ultimaFila + 2 * altoMapa + 10;		// como en zonaVista()
+	}
+
+	/**
+	* Reserva el lienzo para la caja entera de una vista 3D del mapa (la del nivel 0, ver extensionCorte3D()), y la
+	* devuelve para presentarla al terminar: calculaAlto() se puede pasar de altoMapa, y lo que se pinte por debajo tiene
+	* que llegar tambien a la salida
+	*/
+	void reservaCorte3D(int desdeY, int x0, int dx, int grosor, int &bx, int &by, int &bw, int &bh){
+		extensionCorte3D(getNivel(0), desdeY, x0, dx, grosor, bx, by, bw, bh);
+		lienzo.reserva(bx + bw, by + bh);
+	}
+
+	/**
+	* La misma caja, recortada al lienzo y a su recorte. Devuelve false si queda vacia
+	*/
+	bool cajaCorte3D(const Nivel &n, int desdeY, int x0, int dx, int grosor, int &bx, int &by, int &bw, int &bh) const {
+		extensionCorte3D(n, desdeY, x0, dx, grosor, bx, by, bw, bh);
+		return lienzo.recorta(bx, by, bw, bh);
+	}
+
+	/**
+	* Pinta la franja f de una vista 3D completa, de delante a atras (ver pintaCorte3D())
+	*/
+	void pintaFranja3D(const Nivel &n, int desdeY, int x0, int dx, int grosor, COLORREF c, FranjaCorte &f){
+		bool borrar = (c == RGB(0,0,0));
+		int fondoVista = 2 * altoMapa + 10;
+		std::vector<int> altos(n.lado);
+		for (int y = n.lado - 1; y >= 0; --y)
+		{
+			// solo las casillas de la fila que pintan dentro de la franja (ver celdasVisibles())
+			if (desdeY + y >= f.y + f.alto || desdeY + y + fondoVista <= f.y) continue;
+			int xFila = x0 + dx * y;
+			int desde = divAbajo(f.x - xFila, grosor);
+			int hasta = divAbajo(f.x + f.ancho - 1 - xFila, grosor) + 1;
+			if (desde < 0) desde = 0;
+			if (hasta > n.lado) hasta = n.lado;
+			if (desde >= hasta) continue;
+			altosNivel(n, y, desde, hasta, &altos[0]);
+			int agua = desdeY + alturaAgua + y;
+			int fondo = desdeY + altoMapa + y;
+			for (int i = desde; i < hasta; ++i){
+				// los colores solo se buscan si algo de la casilla se llega a pintar
+				int alto = altos[i];
+				int tope = desdeY + alto + y;
+				bool conAgua = (alto > alturaAgua);
+				bool linea = (alto % 10 == 0);
+				int xa = xFila + i * grosor;
+				int xb = xa + grosor;
+				if (xa < f.x) xa = f.x;
+				if (xb > f.x + f.ancho) xb = f.x + f.ancho;
+				for (int x = xa; x < xb; ++x){
+					int &h = f.horizonte[x - f.x];
+					if (conAgua && (agua < h || agua >= fondo)){
+						pintaTramo(f, x, agua, agua + 1, borrar ? c : paleta.getAgua(alto));
+					}
+					int fin = (fondo < h) ? fondo : h;
+					if (tope < fin){
+						if (linea){
+							pintaTramo(f, x, tope, tope + 1, borrar ? c : paleta.getSuave(alto));
+						}
+						pintaTramo(f, x, linea ? tope + 1 : tope, fin, borrar ? c : paleta.getTerreno(alto));
+						h = tope;
+					}
+					else if (linea && tope >= fondo){
+						pintaTramo(f, x, tope, tope + 1, borrar ? c : paleta.getSuave(alto));
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	* Pinta las vistas 3D Quick (mostrarCorte3DLRQuick(), ...RL y ...Front) con la misma colocacion que pintaCorte3D(),
+	* pero de atras a delante y con columnas de 10 pixeles (de altoMapa en la casilla borde, si la hay: la primera
+	* columna que se ve entera por un lado). Las columnas del lienzo se reparten en franjas entre los hilos de
+	* representacion: cada hilo pinta todas las filas en orden, pero solo dentro de su franja
+	*/
+	void pintaCorte3DQuick(int desdeY, int x0, int dx, int grosor, COLORREF c, int borde){
+		if (grosor <= 0) return;
+		Nivel n = getNivel(0);
+		int bx, by, bw, bh;
+		if (!cajaCorte3D(n, desdeY, x0, dx, grosor, bx, by, bw, bh)) return;
+		bool borrar = (c == RGB(0,0,0));
+		std::atomic<long long> escritos(0);
+		enParalelo(bw, this->size, hilosVista(), [&](int primera, int ultima){
+			int fx = bx + primera;
+			int fx1 = bx + ultima;
+			long long pintados = 0;
+			std::vector<int> altos(size);
+			std::vector<COLORREF> colores(size, c);
+			for (int y = 0; y < size; ++y)
+			{
+				int offset = y;		// cada fila se pinta un pixel mas abajo que la anterior
+				int xFila = x0 + dx * y;
+				int desde, hasta;
+				if (!celdasVisibles(desdeY + offset, 2 * altoMapa + 10, xFila, grosor, desde, hasta)) continue;
+				int primeraCasilla = divAbajo(fx - xFila, grosor);
+				int ultimaCasilla = divAbajo(fx1 - 1 - xFila, grosor);
+				if (primeraCasilla > desde) desde = primeraCasilla;
+				if (ultimaCasilla + 1 < hasta) hasta = ultimaCasilla + 1;
+				if (desde >= hasta) continue;
+				altosFila(y, desde, hasta, &altos[0]);
+				if (!borrar){
+					paleta.coloreaTerreno(&altos[desde], hasta - desde, &colores[desde]);
+				}
+				for (int i = desde; i < hasta; ++i){
+					int alto = altos[i];
+					int end = (i == borde) ? altoMapa : alto + 10;
+					int x = xFila + i * grosor;
+					int ancho = grosor;
+					if (x < fx){ ancho -= fx - x; x = fx; }
+					if (x + ancho > fx1) ancho = fx1 - x;
+					if (alto > alturaAgua){
+						pintados += lienzo.rellenaRectSinContar(x, desdeY + alturaAgua + offset, ancho, 1, borrar ? c : paleta.getAgua(alto));
+					}
+					pintados += lienzo.rellenaRectSinContar(x, desdeY + alto + offset, ancho, end - alto, colores[i]);
+					if (alto % 10 == 0){
+						pintados += lienzo.rellenaRectSinContar(x, desdeY + alto + offset, ancho, 1, borrar ? c : paleta.getSuave(alto));
+					}
+				}
+			}
+			escritos += pintados;
+		});
+		lienzo.cuentaEscritos(escritos);
+	}
+
+	/**
+	* Devuelve en (x,y,ancho,alto) la zona del lienzo en la que pintan las casillas r del mapa en la vista v.
+	* En las vistas 3D cada casilla pinta una columna que empieza como pronto en su fila (el alto mas alto es 0) y acaba
+	* antes de 2*altoMapa + 10 pixeles mas abajo (el alto no llega a 2*altoMapa, ver construyePaleta(), y las vistas Quick
+	* pintan 10 pixeles por debajo); en mostrarCorte(), el gris de cada altura se pinta en la fila alto, sin desdeY
+	*/
+	void zonaVista(const Vista &v, const RectCasillas &r, int &x, int &y, int &ancho, int &alto) const {
+		int g = v.anchoPixel;
+		int casillasX = r.x1 - r.x0 + 1;
+		int casillasY = r.y1 - r.y0 + 1;
+		int fondo = 2 * altoMapa + 10;
+		x = v.desdeX + g * r.x0;
+		ancho = g * casillasX;
+		y = v.desdeY + r.y0;
+		alto = casillasY - 1 + fondo;
+		switch (v.tipo){
+		case VISTA_PLANTA:
+			y = v.desdeY + v.altoPixel * r.y0;
+			alto = v.altoPixel * casillasY;
+			break;
+		case VISTA_CORTE:
+			y = 0;
+			alto = v.desdeY + 2 * altoMapa + 1;
+			break;
+		case VISTA_3DLR:
+		case VISTA_3DLR_QUICK:
+			x += r.y0;		// la fila y se pinta y pixeles a la derecha
+			ancho += casillasY - 1;
+			break;
+		case VISTA_3DRL:
+		case VISTA_3DRL_QUICK:
+			x += this->size - r.y1;		// y aqui y pixeles a la izquierda
+			ancho += casillasY - 1;
+			break;
+		default:
+			break;
+		}
+	}
+
+	/**
+	* Apunta la representacion que se esta pintando como la ultima vista (o la olvida, si se esta borrando), y da el
+	* lienzo por actualizado. La zona de la vista se apunta tambien al borrar: es la que limpia borraZonaVista()
+	*/
+	void recuerdaVista(TipoVista tipo, int desdeX, int desdeY, int anchoPixel, int altoPixel, bool borrar){
+		this->vista.tipo = tipo;
+		this->vista.desdeX = desdeX;
+		this->vista.desdeY = desdeY;
+		this->vista.anchoPixel = anchoPixel;
+		this->vista.altoPixel = altoPixel;
+		this->vista.higher = this->higher;
+		this->vista.lower = this->lower;
+		RectCasillas todo = { 0, 0, this->max, this->max };
+		zonaVista(this->vista, todo, this->vista.x, this->vista.y, this->vista.ancho, this->vista.alto);
+		if (borrar) this->vista.tipo = VISTA_NINGUNA;
+		this->sucios.clear();
+		this->todoSucio = false;
+	}
+
+	/**
+	* Borra una representacion sin volver a pintarla en negro: la olvida (ver recuerdaVista()) y deja en negro, con un
+	* solo rellenaRect(), toda la zona del lienzo en la que puede haber pintado (ver zonaVista()). No lee el mapa, asi
+	* que cuesta lo mismo con cualquier detalle. En las vistas 3D la zona es el rectangulo que cubre toda la vista (el
+	* paralelogramo de las filas, hasta el fondo maximo de las columnas), asi que tambien borra lo que hubiera pintado
+	* otra cosa dentro de ese rectangulo
+	*/
+	void borraZonaVista(TipoVista tipo, int desdeX, int desdeY, int anchoPixel, int altoPixel){
+		recuerdaVista(tipo, desdeX, desdeY, anchoPixel, altoPixel, true);
+		const Vista &v = this->vista;
+		lienzo.rellenaRect(v.x, v.y, v.ancho, v.alto, RGB(0, 0, 0));
+		presenta(v.x, v.y, v.ancho, v.alto);
+	}
+
+	/**
+	* Apunta que ha cambiado el sector de tam x tam casillas con esquina en (x0,y0). Si se acumulan muchos, se juntan en
+	* uno solo que los contiene a todos
+	*/
+	void marcaSucio(int x0, int y0, int tam){
+		if (this->todoSucio) return;
+		RectCasillas r = { x0, y0, x0 + tam - 1, y0 + tam - 1 };
+		if (this->sucios.size() >= 64){
+			for (size_t i = 0; i < this->sucios.size(); ++i){
+				if (this->sucios[i].x0 < r.x0) r.x0 = this->sucios[i].x0;
+				if (this->sucios[i].y0 < r.y0) r.y0 = this->sucios[i].y0;
+				if (this->sucios[i].x1 > r.x1) r.x1 = this->sucios[i].x1;
+				if (this->sucios[i].y1 > r.y1) r.y1 = this->sucios[i].y1;
+			}
+			this->sucios.clear();
+		}
+		this->sucios.push_back(r);
+	}
+
+	/**
+	* Vuelve a pintar la vista v entera (o lo que caiga dentro del recorte del lienzo)
+	*/
+	void pintaVista(const Vista &v){
+		COLORREF blanco = RGB(255, 255, 255);
+		switch (v.tipo){
+		case VISTA_PLANTA: mostrarVistaPlanta(v.desdeX, v.desdeY, v.anchoPixel, v.altoPixel, blanco); break;
+		case VISTA_CORTE: mostrarCorte(v.desdeX, v.desdeY, v.anchoPixel); break;
+		case VISTA_3DLR: mostrarCorte3DLR(v.desdeX, v.desdeY, v.anchoPixel, blanco); break;
+		case VISTA_3DRL: mostrarCorte3DRL(v.desdeX, v.desdeY, v.anchoPixel, blanco); break;
+		case VISTA_3DFRONT: mostrarCorte3DFront(v.desdeX, v.desdeY, v.anchoPixel, blanco); break;
+		case VISTA_3DLR_QUICK: mostrarCorte3DLRQuick(v.desdeX, v.desdeY, v.anchoPixel, blanco); break;
+		case VISTA_3DRL_QUICK: mostrarCorte3DRLQuick(v.desdeX, v.desdeY, v.anchoPixel, blanco); break;
+		case VISTA_3DFRONT_QUICK: mostrarCorte3DFrontQuick(v.desdeX, v.desdeY, v.anchoPixel, blanco); break;
+		default: break;
+		}
+	}
+
+	/**
+	* Construye la paleta por defecto (la de calculaColor(), calculaColorSuave() y calculaColorAgua()) para el altoMapa y
+	* la alturaAgua actuales. Si hay una paleta propia, no hace nada.
+	* calculaAlto() puede pasarse algo de altoMapa (el rango se divide entre su parte entera), pero nunca llega a
+	* 2*altoMapa, asi que con 2*altoMapa + 1 entradas la paleta da lo mismo que las funciones para cualquier alto
+	*/
+	void construyePaleta(){
+		if (this->paletaPropia) return;
+		this->paleta = Paleta(2 * altoMapa + 1);
+		for (int alto = 0; alto <= 2 * altoMapa; ++alto){
+			this->paleta.setTerreno(alto, calculaColor(alto));
+			this->paleta.setSuave(alto, calculaColorSuave(alto));
+			this->paleta.setAgua(alto, calculaColorAgua(alto));
+		}
 	}
 
 	/**
@@ -278,7 +1457,7 @@ private:
 			int altoMin = 2 * altoMapa / 7;
 			int altoMax = 3 *  altoMapa / 7;
 			valorA = 64 + ((alto - altoMin) * 64 / (altoMax - altoMin));
-			color = RGB(0, valorA, 0,);
+			color = RGB(0, valorA, 0);
 		}
 		else if (alto < 4 * altoMapa / 7){
 			/*
@@ -363,66 +1542,517 @@ private:
 		return color;
 	}
 
+	/**
+	* Vuelca al destino (si lo hay) el rectangulo del lienzo que se acaba de pintar
+	*/
+	void presenta(int x, int y, int ancho, int alto){
+		if (this->salida != NULL && lienzo.recorta(x, y, ancho, alto)){
+			this->salida->presenta(lienzo, x, y, ancho, alto);
+		}
+	}
+
+	/**
+	* Indica si la matriz de alturas es la de un fichero abierto en solo lectura (no se puede escribir en ella)
+	*/
+	bool soloLectura(){
+		return this->archivo != NULL && this->archivo->esSoloLectura();
+	}
+
+	/**
+	* Si el mapa esta sobre un fichero, guarda en su cabecera los datos del mapa recien generado
+	*/
+	void guardaCabecera(){
+		if (this->archivo != NULL){
+			this->archivo->guardaCabecera(this->seed, this->roughness, this->higher, this->lower,
+				this->cuant.getBase(), this->cuant.getPaso());
+		}
+	}
+
+	/**
+	* Devuelve el tamano (2^lado + 1) del sector con esquina en (origX, origY), o 0 si no cabe en el mapa
+	*/
+	int tamSector(int origX, int origY, int lado){
+		if (origX >= 0 && origX < size && origY >= 0 && origY < size){
+			int tam = pow(2, lado) + 1;
+			int destX = origX + tam;
+			int destY = origY + tam;
+			if (destX >= 0 && destX < size && destY >= 0 && destY < size){
+				return tam;
+			}
+		}
+		return 0;
+	}
+
+	/**
+	* Regenera en su sitio (ver VistaSector) el sector de tam x tam casillas con esquina en (origX, origY), con un
+	* generador de semilla 'semilla'. Amplia antes y despues con los limites del sector antes y despues de regenerarlo.
+	* Como siempre, la altura central se trunca a entero
+	*/
+	void regeneraSector(int origX, int origY, int tam, float roughness, float centralHeight, uint32_t semilla,
+		Limites &antes, Limites &despues){
+		VistaSector vista(this, origX, origY, tam, roughness, Rng(semilla));
+		Limites nuevos;
+		antes.junta(buscaLimites());
+		divideSector(this->max, (int)centralHeight, &nuevos);
+		if (nuevos.vacio()) nuevos = buscaLimites();
+		despues.junta(nuevos);
+	}
+
+	/**
+	* Amplia rango con las alturas que puede dejar regenerar el sector de tam x tam casillas con esquina en
+	* (origX, origY): cada nivel de lado 'lado' se aleja como mucho roughness*lado de la media, asi que no se sale de la
+	* mas baja y la mas alta de entre sus esquinas y la altura central, +- 2*roughness*tam (ver ajustaCuantizacion())
+	*/
+	void rangoEdicion(int origX, int origY, int tam, float roughness, float centralHeight, Limites &rango){
+		Limites l;
+		l.junta((float)(int)centralHeight);	// la altura central se trunca, ver regeneraSector()
+		l.junta(get(origX, origY));
+		l.junta(get(origX + tam - 1, origY));
+		l.junta(get(origX, origY + tam - 1));
+		l.junta(get(origX + tam - 1, origY + tam - 1));
+		float margen = 2 * fabsf(roughness) * tam + 1;
+		l.menor -= margen;
+		l.mayor += margen;
+		rango.junta(l);
+	}
+
+	/**
+	* Antes de editar: si las alturas de rango no caben en la cuantizacion (solo pasa con uint16_t, cuyo rango se fija al
+	* generar), la amplia hasta que quepan, con un cuarto mas de margen por el lado que se sale (para que las siguientes
+	* ediciones no tengan que volver a hacerlo), y vuelve a codificar con ella todas las muestras del mapa y de la
+	* piramide. Cada vez se pierde como mucho medio paso de precision; sin esto, lo que se saliera se quedaria en el
+	* extremo y la edicion saldria aplanada
+	*/
+	void cuantizacionPara(const Limites &rango){
+		if (rango.vacio() || this->cuant.cubre(rango.menor, rango.mayor)) return;
+		float base = this->cuant.getBase();
+		float tope = base + 65535 * this->cuant.getPaso();
+		float menor = (rango.menor < base) ? rango.menor : base;
+		float mayor = (rango.mayor > tope) ? rango.mayor : tope;
+		float margen = (mayor - menor) / 4;
+		if (rango.menor < base) menor -= margen;
+		if (rango.mayor > tope) mayor += margen;
+		Cuantizacion<Sample> nueva = this->cuant;
+		nueva.ajusta(menor, mayor);
+		size_t n = (size_t)this->size * this->size;
+		for (size_t i = 0; i < n; ++i){
+			this->map[i] = nueva.codifica(this->cuant.decodifica(this->map[i]));
+		}
+		for (size_t nivel = 1; nivel < this->piramide.size(); ++nivel){
+			std::vector<Sample> &copia = this->piramide[nivel];
+			for (size_t i = 0; i < copia.size(); ++i){
+				copia[i] = nueva.codifica(this->cuant.decodifica(copia[i]));
+			}
+		}
+		this->cuant = nueva;
+		this->todoSucio = true;		// las alturas pueden haber cambiado en medio paso
+	}
+
+	/**
+	* Actualiza higher y lower despues de regenerar uno o varios sectores, a partir de los limites de lo que habia en ellos
+	* (antes) y de lo que se ha escrito (despues). Si el maximo (o minimo) del mapa no estaba en ningun sector, sigue
+	* estando fuera, y basta con compararlo con lo escrito. Solo si podia estar en alguno (y se ha podido perder al
+	* sobreescribirlo) hay que volver a recorrer el mapa
+	*/
+	void actualizaLimites(const Limites &antes, const Limites &despues){
+		if (antes.mayor < this->higher && antes.menor > this->lower){
+			if (despues.mayor > this->higher) this->higher = despues.mayor;
+			if (despues.menor < this->lower) this->lower = despues.menor;
+		}
+		else {
+			fijaLimites(Limites());
+		}
+		guardaCabecera();
+	}
+
+	/**
+	* Reparte las ediciones validas (tam[i] > 0) en oleadas, de forma que dos ediciones de una misma oleada nunca se
+	* pisan, y una edicion va siempre en una oleada posterior a la de todas las anteriores (en la lista) con las que se
+	* pisa. Asi, haciendo las oleadas una detras de otra, y cada una en paralelo, el resultado es el mismo que haciendo
+	* las ediciones en orden.
+	* El mapa se divide en celdas de celda x celda casillas, y cada celda recuerda la ultima oleada que la ha tocado: una
+	* edicion va en la oleada siguiente a la mayor de las celdas que toca. Dos ediciones que comparten celda sin llegar a
+	* pisarse tambien van en oleadas distintas, pero eso solo cuesta algo de paralelismo
+	*/
+	std::vector<std::vector<int> > reparteOleadas(const std::vector<EdicionSector> &ediciones, const std::vector<int> &tams){
+		int celda = (this->size / 128 > 16) ? this->size / 128 : 16;
+		int celdas = (this->size + celda - 1) / celda;
+		std::vector<int> ultima(celdas * celdas, -1);
+		std::vector<std::vector<int> > oleadas;
+		for (size_t i = 0; i < ediciones.size(); ++i){
+			if (tams[i] == 0) continue;
+			int cx0 = ediciones[i].origX / celda, cx1 = (ediciones[i].origX + tams[i] - 1) / celda;
+			int cy0 = ediciones[i].origY / celda, cy1 = (ediciones[i].origY + tams[i] - 1) / celda;
+			int oleada = 0;
+			for (int cy = cy0; cy <= cy1; ++cy){
+				for (int cx = cx0; cx <= cx1; ++cx){
+					if (ultima[cx + celdas * cy] + 1 > oleada) oleada = ultima[cx + celdas * cy] + 1;
+				}
+			}
+			for (int cy = cy0; cy <= cy1; ++cy){
+				for (int cx = cx0; cx <= cx1; ++cx){
+					ultima[cx + celdas * cy] = oleada;
+				}
+			}
+			if (oleada == (int)oleadas.size()) oleadas.push_back(std::vector<int>());
+			oleadas[oleada].push_back((int)i);
+		}
+		return oleadas;
+	}
+
+	/**
+	* CONSTRUCTORA DE TRABAJO
+	* Un mapa que comparte la matriz de alturas (y la cuantizacion) de otro, para que varios hilos puedan regenerar a la
+	* vez sectores distintos de la misma matriz, cada uno con su VistaSector (ver modificaSectores()). No se representa
+	* ni escribe en el fichero del original
+	*/
+	explicit BasicMap(BasicMap *original){
+		this->size = original->size;
+		this->max = original->max;
+		this->map = (Sample*)original->map;	// la matriz sigue siendo del original
+		this->cuant = original->cuant;
+		this->altoMapa = original->altoMapa;
+		this->alturaAgua = original->alturaAgua;
+		this->paletaPropia = true;	// no se va a representar, no hace falta construir la paleta
+		MAPGEN_STAT(this->contadores = NULL;)
+		this->vista.tipo = VISTA_NINGUNA;
+		this->todoSucio = true;
+		this->conPiramide = false;
+		this->observador = NULL;
+		this->hilosRepresentacion = 0;
+		this->generando = false;
+		this->seed = original->seed;
+		this->roughness = original->roughness;
+		this->higher = original->higher;
+		this->lower = original->lower;
+		this->archivo = NULL;
+		this->salida = NULL;
+	}
+
+	/**
+	* Fija el rango de la cuantizacion (solo cuenta para uint16_t) antes de generar con el roughness actual.
+	* Las esquinas parten de max*3/4, y cada nivel de lado 'lado' se puede alejar como mucho roughness*lado de la media,
+	* asi que en total no se sale de max*3/4 +- 2*roughness*max. Se deja otro roughness*max de margen por los offsets de
+	* las esquinas y los bordes de generateTile()
+	*/
+	void ajustaCuantizacion(){
+		ajustaCuantizacion(this->cuant, this->max, this->roughness);
+	}
+
+	static void ajustaCuantizacion(Cuantizacion<Sample> &cuant, int max, float roughness){
+		float centro = max * 3 / 4;
+		float margen = 3 * fabsf(roughness) * max + 1;
+		cuant.ajusta(centro - margen, centro + margen);
+	}
+
 public:
 
 	// CONTRUCTORA SIN SEMILLA
-	Map(int detail){
+	BasicMap(int detail, const Alloc &alloc = Alloc()) : map(alloc){
 		this->size = pow(2,detail) +1;
 		this->max = size - 1;
-		this->map = new float[size * size];
+		this->map.reserva((size_t)size * size);
 		this->altoMapa = 200;
 		this->alturaAgua = 3 * altoMapa / 5; // a partir de 3/5 de la altura hay agua
+		this->paletaPropia = false;
+		construyePaleta();
+		MAPGEN_STAT(this->contadores = NULL;)
+		this->vista.tipo = VISTA_NINGUNA;
+		this->todoSucio = true;
+		this->conPiramide = false;
+		this->observador = NULL;
+		this->hilosRepresentacion = 0;
+		this->generando = false;
 		this->seed = time(NULL);
-		srand(this->seed);
-		this->hdc = GetDC(GetConsoleWindow()); // Get the DC from console
+		this->rng = Rng(this->seed);
+		this->archivo = NULL;
+#ifdef _WIN32
+		this->salida = GdiSink::consola(); // Se pinta sobre la ventana de la consola
+#else
+		this->salida = NULL;
+#endif
 	}
 
 	// CONSTRUCTORA CON SEMILLA
-	Map(int detail, int seed){
+	BasicMap(int detail, int seed, const Alloc &alloc = Alloc()) : map(alloc){
+		this->size = pow(2, detail) + 1;
+		this->max = size - 1;
+		this->map.reserva((size_t)size * size);
+		this->altoMapa = 200;
+		this->alturaAgua = 3 * altoMapa / 5; // a partir de 3/5 de la altura hay agua
+		this->paletaPropia = false;
+		construyePaleta();
+		MAPGEN_STAT(this->contadores = NULL;)
+		this->vista.tipo = VISTA_NINGUNA;
+		this->todoSucio = true;
+		this->conPiramide = false;
+		this->observador = NULL;
+		this->hilosRepresentacion = 0;
+		this->generando = false;
+		this->seed = seed;
+		this->rng = Rng(this->seed);
+		this->archivo = NULL;
+#ifdef _WIN32
+		this->salida = GdiSink::consola();
+#else
+		this->salida = NULL;
+#endif
+	}
+
+	/**
+	* CONSTRUCTORA SOBRE UN FICHERO DE ALTURAS
+	* La matriz de alturas es la del fichero (ya abierto o creado), asi que generate() escribe directamente en el, y al
+	* terminar guarda en su cabecera seed, roughness, higher y lower.
+	* Si el fichero se ha abierto en solo lectura (HeightFile::abre()), el mapa ya esta generado y se puede representar
+	* directamente, pero no se puede volver a generar ni modificar.
+	* Para mapas que no caben en memoria conviene usar generate(roughness, threads), que recorre cada nivel del mapa una
+	* sola vez (generate(roughness) hace dos pasadas por nivel).
+	* El fichero tiene que seguir abierto mientras se use el mapa, y ser del mismo tipo de muestra que el mapa (al crearlo,
+	* HeightFile::crea(ruta, detail, seed, Cuantizacion<Sample>::tipo)). Si no esta abierto (crea() o abre() han
+	* fallado) o sus muestras son de otro tipo, lanza std::invalid_argument: las alturas no se podrian leer bien
+	*/
+	BasicMap(HeightFile &archivo){
+		const CabeceraAlturas *cabecera = archivo.getCabecera();
+		if (!archivo.abierto() || cabecera == NULL){
+			throw std::invalid_argument("BasicMap: el fichero de alturas no esta abierto");
+		}
+		if (cabecera->muestra != Cuantizacion<Sample>::tipo){
+			throw std::invalid_argument("BasicMap: el fichero de alturas es de otro tipo de muestra que el mapa");
+		}
+		this->size = pow(2, cabecera->detail) + 1;
+		this->max = size - 1;
+		this->map = (Sample*)archivo.getAlturas();
+		this->cuant.restaura(cabecera->cuantBase, cabecera->cuantPaso);
+		this->altoMapa = 200;
+		this->alturaAgua = 3 * altoMapa / 5; // a partir de 3/5 de la altura hay agua
+		this->paletaPropia = false;
+		construyePaleta();
+		MAPGEN_STAT(this->contadores = NULL;)
+		this->vista.tipo = VISTA_NINGUNA;
+		this->todoSucio = true;
+		this->conPiramide = false;
+		this->observador = NULL;
+		this->hilosRepresentacion = 0;
+		this->generando = false;
+		this->seed = cabecera->seed;
+		this->rng = Rng(this->seed);
+		this->roughness = cabecera->roughness;
+		this->higher = cabecera->higher;
+		this->lower = cabecera->lower;
+		this->archivo = &archivo;
+#ifdef _WIN32
+		this->salida = GdiSink::consola();
+#else
+		this->salida = NULL;
+#endif
+	}
+
+	/**
+	* CONSTRUCTORA SOBRE UNA MATRIZ AJENA
+	* Igual que BasicMap(detail, seed), pero las alturas se guardan en 'alturas' (como minimo size*size muestras), que
+	* no es del mapa: tiene que seguir existiendo mientras se use el mapa, y el mapa nunca la libera. Sirve para
+	* reutilizar la misma memoria en muchos mapas seguidos (ver BasicMapBatch en Batch.hpp)
+	*/
+	BasicMap(int detail, int seed, Sample *alturas){
 		this->size = pow(2, detail) + 1;
 		this->max = size - 1;
-		this->map = new float[size * size];
+		this->map = alturas;
 		this->altoMapa = 200;
 		this->alturaAgua = 3 * altoMapa / 5; // a partir de 3/5 de la altura hay agua
+		this->paletaPropia = false;
+		construyePaleta();
+		MAPGEN_STAT(this->contadores = NULL;)
+		this->vista.tipo = VISTA_NINGUNA;
+		this->todoSucio = true;
+		this->conPiramide = false;
+		this->observador = NULL;
+		this->hilosRepresentacion = 0;
+		this->generando = false;
 		this->seed = seed;
-		srand(this->seed);
-		this->hdc = GetDC(GetConsoleWindow());
+		this->rng = Rng(this->seed);
+		this->archivo = NULL;
+#ifdef _WIN32
+		this->salida = GdiSink::consola();
+#else
+		this->salida = NULL;
+#endif
+	}
+
+	/**
+	* Un mapa no se puede copiar: la matriz tiene un solo dueno y se libera una sola vez
+	*/
+	BasicMap(const BasicMap&) = delete;
+	BasicMap& operator=(const BasicMap&) = delete;
+
+	/**
+	* Mover un mapa le pasa la matriz (sin copiarla) y todo lo demas; el mapa movido queda vacio y solo se puede
+	* destruir o recibir otro mapa. Al recibir otro mapa, la matriz que tuviera se libera
+	*/
+	BasicMap(BasicMap &&otro) = default;
+	BasicMap& operator=(BasicMap &&otro) = default;
+
+	// METODOS PUBLICOS
+
+	/**
+	* Inicializa el mapa con los valores de altura (llamada a divide), y establece los valores higher y lower
+	*/
+	void generate(float roughness) {
+		if (soloLectura()) return;
+		MAPGEN_STAT(empiezaEstadisticas();)
+		this->generando = true;
+		this->roughness = roughness;
+		// Roughness, valor entre 0 y 1 (aunque puede ser > 1)
+		ajustaCuantizacion();
+		this->set(0, 0, this->max * 3 / 4);
+		this->set(this->max, 0, this->max * 3 / 4);
+		this->set(this->max, this->max, this->max * 3 / 4);
+		this->set(0, this->max, this->max * 3 / 4);
+		/* 
+		* Se pone un valor igual para todas las esquinas (size/3). Esto se puede variar, si se quiere, por ejemplo
+		* un mapa que caiga o que tenga una elevacion hacia una o varia esquinas.
+		*/
+
+		Limites limites;	// se recogen al calcular el ultimo nivel, sin volver a recorrer el mapa
+		divide(this->max, &limites);
+		fijaLimites(limites);
+		this->generando = false;
+		this->todoSucio = true;
+		MAPGEN_STAT(terminaEstadisticas();)
+		guardaCabecera();
+	};
+
+	/**
+	* Igual que generate(roughness), pero el offset aleatorio de cada casilla sale de un hash de (seed, nivel, x, y) en vez
+	* del generador del mapa, y cada nivel se calcula repartido entre 'threads' hilos (con threads <= 0 se usan todos los nucleos).
+	* El mapa generado es distinto al de generate(roughness) con la misma semilla, pero es identico bit a bit sea cual
+	* sea el numero de hilos
+	*/
+	void generate(float roughness, int threads) {
+		if (soloLectura()) return;
+		MAPGEN_STAT(empiezaEstadisticas();)
+		this->generando = true;
+		if (threads <= 0) threads = std::thread::hardware_concurrency();
+		this->roughness = roughness;
+		ajustaCuantizacion();
+		this->set(0, 0, this->max * 3 / 4);
+		this->set(this->max, 0, this->max * 3 / 4);
+		this->set(this->max, this->max, this->max * 3 / 4);
+		this->set(0, this->max, this->max * 3 / 4);
+		Limites limites;
+		divideHash(this->max, threads, false, &limites);
+		fijaLimites(limites);
+		this->generando = false;
+		this->todoSucio = true;
+		MAPGEN_STAT(terminaEstadisticas();)
+		guardaCabecera();
+	}
+
+	/**
+	* Altura que tendria la casilla (x,y) de un mapa de detalle 'detail' y semilla seed despues de
+	* generate(roughness, threads), sin crear ni generar el mapa: solo se calculan las casillas de las que depende (ver
+	* ConoAlturas), unas pocas por nivel. Devuelve -1 si la posicion es invalida
+	*/
+	static float heightAt(int seed, float roughness, int detail, int x, int y) {
+		int max = 1 << detail;
+		if (x < 0 || x > max || y < 0 || y > max) return -1;
+		ConoAlturas cono(seed, roughness, detail);
+		return cono.altura(x, y);
+	}
+
+	/**
+	* Igual que heightAt(seed, roughness, detail, x, y), para las n casillas (xs[i], ys[i]): deja la altura de cada una en
+	* alturas[i]. Todas las consultas comparten las casillas ya calculadas, asi que las que estan cerca solo calculan lo
+	* que no tienen en comun (si solo hacen falta unas pocas casillas, sale mucho mas barato que generar el mapa)
+	*/
+	static void heightAt(int seed, float roughness, int detail, const int *xs, const int *ys, int n, float *alturas) {
+		int max = 1 << detail;
+		ConoAlturas cono(seed, roughness, detail);
+		for (int i = 0; i < n; ++i){
+			bool valida = xs[i] >= 0 && xs[i] <= max && ys[i] >= 0 && ys[i] <= max;
+			alturas[i] = valida ? cono.altura(xs[i], ys[i]) : -1;
+		}
 	}
 
-	// METODOS PUBLICOS
+	/**
+	* Semilla de un tile a partir de la semilla del mundo y de su posicion. Cualquier tile se puede volver a generar por
+	* separado, sin necesitar a sus vecinos
+	*/
+	static uint32_t tileSeed(uint32_t worldSeed, int tileX, int tileY) {
+		return hashCelda(worldSeed, 0xFFFFFFFFu, (uint32_t)tileX, (uint32_t)tileY);
+	}
 
 	/**
-	* Inicializa el mapa con los valores de altura (llamada a divide), y establece los valores higher y lower
+	* Genera el mapa como el tile (tileX, tileY) de un mundo infinito con semilla worldSeed (ver World.hpp).
+	* Los tiles vecinos comparten la fila o columna del borde: el tile (tileX, tileY) va de la casilla global
+	* (tileX*max, tileY*max) a la (tileX*max + max, tileY*max + max).
+	* Las esquinas y los bordes solo dependen de la semilla del mundo y de las coordenadas globales, asi que son iguales
+	* en los dos tiles que los comparten. El interior se genera como en generate(roughness, threads), con la semilla
+	* tileSeed(), sin tocar los bordes.
 	*/
-	void generate(float roughness) {
+	void generateTile(float roughness, uint32_t worldSeed, int tileX, int tileY, int threads) {
+		if (soloLectura()) return;
+		MAPGEN_STAT(empiezaEstadisticas();)
+		this->generando = true;
+		if (threads <= 0) threads = std::thread::hardware_concurrency();
 		this->roughness = roughness;
-		// Roughness, valor entre 0 y 1 (aunque puede ser > 1)
-		this->set(0, 0, this->max * 3 / 4);
-		this->set(this->max, 0, this->max * 3 / 4);
-		this->set(this->max, this->max, this->max * 3 / 4);
-		this->set(0, this->max, this->max * 3 / 4);
-		/* 
-		* Se pone un valor igual para todas las esquinas (size/3). Esto se puede variar, si se quiere, por ejemplo
-		* un mapa que caiga o que tenga una elevacion hacia una o varia esquinas.
-		*/
-
-		divide(this->max);
-		this->higher = findHigher();
-		this->lower = findLower();
-	};
+		this->seed = (int)tileSeed(worldSeed, tileX, tileY);
+		ajustaCuantizacion();
+		uint32_t gx0 = (uint32_t)tileX * this->max;
+		uint32_t gy0 = (uint32_t)tileY * this->max;
+		float scale = roughness * this->max;
+		for (int cy = 0; cy <= this->max; cy += this->max) {
+			for (int cx = 0; cx <= this->max; cx += this->max) {
+				// Igual que en generate(), todas las esquinas parten de max*3/4, pero aqui cada una con su offset
+				this->set(cx, cy, this->max * 3 / 4 + offsetGlobal(worldSeed, 0, gx0 + cx, gy0 + cy, scale));
+			}
+		}
+		bordeTile(worldSeed, gx0, gy0, 0, 0, 1, 0);				// arriba
+		bordeTile(worldSeed, gx0, gy0, 0, this->max, 1, 0);		// abajo
+		bordeTile(worldSeed, gx0, gy0, 0, 0, 0, 1);				// izquierda
+		bordeTile(worldSeed, gx0, gy0, this->max, 0, 0, 1);		// derecha
+		Limites limites;
+		divideHash(this->max, threads, true, &limites);
+		fijaLimites(limites);
+		this->generando = false;
+		this->todoSucio = true;
+		MAPGEN_STAT(terminaEstadisticas();)
+		guardaCabecera();
+	}
 
 	/**
 	* Inicializa un sector con los valores de altura (llamada a divideSector), y establece los valores higher y lower
 	* Este metodo parte del hecho de que los valores ya estan establecidos.
-	* Su uso se limita al ambito de modificaSector(), donde se crea un nuevo mapa, mas pequeo que el original, y sobre el
-	* se recalcula un nuevo terreno.
+	* Regenera todo el mapa salvo las esquinas (y el centro, que pasa a ser centralHeight). modificaSector() hace lo mismo
+	* sobre un sector del mapa, sin crear otro mapa (ver VistaSector).
 	*/
 	void generateSector(float roughness, int centralHeight) {
+		if (soloLectura()) return;
+		MAPGEN_STAT(empiezaEstadisticas();)
+		this->generando = true;
 		this->roughness = roughness;
 		// Roughness, valor entre 0 y 1 (aunque puede ser > 1)
-		divideSector(this->max, centralHeight);
-		this->higher = findHigher();
-		this->lower = findLower();
+		// Las esquinas se conservan: se leen con la cuantizacion de antes y se vuelven a guardar con la nueva, que tiene
+		// que cubrirlas tambien a ellas y a la altura central (ver rangoEdicion())
+		Limites rango;
+		rangoEdicion(0, 0, this->size, roughness, (float)centralHeight, rango);
+		float esquinas[4] = { get(0, 0), get(this->max, 0), get(this->max, this->max), get(0, this->max) };
+		ajustaCuantizacion();
+		if (!this->cuant.cubre(rango.menor, rango.mayor)){
+			rango.junta(this->cuant.getBase());
+			rango.junta(this->cuant.getBase() + 65535 * this->cuant.getPaso());
+			this->cuant.ajusta(rango.menor, rango.mayor);
+		}
+		this->set(0, 0, esquinas[0]);
+		this->set(this->max, 0, esquinas[1]);
+		this->set(this->max, this->max, esquinas[2]);
+		this->set(0, this->max, esquinas[3]);
+		Limites limites;
+		divideSector(this->max, centralHeight, &limites);
+		fijaLimites(limites);
+		this->generando = false;
+		this->todoSucio = true;
+		MAPGEN_STAT(terminaEstadisticas();)
+		guardaCabecera();
 	};
 
 	/**
@@ -431,16 +2061,16 @@ public:
 	* mapa.
 	*/
 	void borrarVistaPlanta(){
-		mostrarVistaPlanta(0, 0, 5, 5, RGB(0,0,0));
+		borrarVistaPlanta(0, 0, 5, 5);
 	}
 	void borrarVistaPlanta(int desdeX, int desdeY){
-		mostrarVistaPlanta(desdeX, desdeY, 5, 5, RGB(0, 0, 0));
+		borrarVistaPlanta(desdeX, desdeY, 5, 5);
 	}
 	void borrarVistaPlanta(int pixelWidth, float pixelHeight){
-		mostrarVistaPlanta(0, 0, pixelWidth, pixelHeight, RGB(0, 0, 0));
+		borrarVistaPlanta(0, 0, pixelWidth, pixelHeight);
 	}
 	void borrarVistaPlanta(int desdeX, int desdeY, int pixelWidth, float pixelHeight){
-		mostrarVistaPlanta(desdeX, desdeY, pixelWidth, pixelHeight, RGB(0, 0, 0));
+		borraZonaVista(VISTA_PLANTA, desdeX, desdeY, pixelWidth, (int)pixelHeight);
 	}
 	void mostrarVistaPlanta(){
 		mostrarVistaPlanta(0,0,5, 5, RGB(255,255,255));
@@ -456,29 +2086,35 @@ public:
 		mostrarVistaPlanta(desdeX, desdeY, pixelWidth, pixelHeight, RGB(255, 255, 255));
 	}
 	void mostrarVistaPlanta(int desdeX, int desdeY, int pixelWidth, int pixelHeight, COLORREF c){
+		MAPGEN_STAT(MedidaRepresentacion medida(this, "mostrarVistaPlanta");)
 		bool borrar = (c == RGB(0, 0, 0));
+		recuerdaVista(VISTA_PLANTA, desdeX, desdeY, pixelWidth, pixelHeight, borrar);
 		int anchoPixel = pixelWidth;
 		int altoPixel = pixelHeight;
-		int x, y; 
-		int alto;
-		COLORREF color;
-		for (int i = 0; i < size*size; i++)
-		{
-			alto = calculaAlto(map[i]);
-			if (borrar){
-				color = c;
-			}
-			else{
-				color = calculaColor(alto);
-			}
-			x = (i % size);
-			y = (i / size);
-			for (int j = desdeX; j < desdeX + anchoPixel; ++j){
-				for (int k = desdeY; k < desdeY + altoPixel; ++k)
-				SetPixel(hdc, (anchoPixel * x) + j, (altoPixel * y) + k, color);
-				// Prototipo: SetPixel(HDC hdc, int x, int y, COLORREF color)
+		lienzo.reserva(desdeX + anchoPixel * size, desdeY + altoPixel * size);
+		// cada fila del mapa pinta sus propias filas del lienzo, asi que se reparten por bandas entre los hilos
+		std::atomic<long long> escritos(0);
+		enParalelo(size, size, hilosVista(), [&](int primera, int ultima){
+			long long pintados = 0;
+			std::vector<int> altos(size);
+			std::vector<COLORREF> colores(size, c);
+			for (int y = primera; y < ultima; y++)
+			{
+				int desde, hasta;
+				if (!celdasVisibles(desdeY + (altoPixel * y), altoPixel, desdeX, anchoPixel, desde, hasta)) continue;
+				if (!borrar){
+					altosFila(y, desde, hasta, &altos[0]);
+					paleta.coloreaTerreno(&altos[desde], hasta - desde, &colores[desde]);
+				}
+				for (int x = desde; x < hasta; x++){
+					pintados += lienzo.rellenaRectSinContar(desdeX + (anchoPixel * x), desdeY + (altoPixel * y), anchoPixel,
+						altoPixel, colores[x]);
+				}
 			}
-		}
+			escritos += pintados;
+		});
+		lienzo.cuentaEscritos(escritos);
+		presenta(desdeX, desdeY, anchoPixel * size, altoPixel * size);
 	}
 
 	/**
@@ -495,44 +2131,47 @@ public:
 		mostrarCorte(0, 0, grosor);
 	}
 	void mostrarCorte(int desdeX, int desdeY, int grosor){
-		int x, y;
-		COLORREF color, colorS;
+		MAPGEN_STAT(MedidaRepresentacion medida(this, "mostrarCorte");)
+		recuerdaVista(VISTA_CORTE, desdeX, desdeY, grosor, grosor, false);
 		COLORREF negro = RGB(0, 0, 0);
 		int alto;
-		for (int i = 0; i < size*size; i++)
-		{			
-			alto = calculaAlto(map[i]);
-			color = calculaColor(alto);
-			colorS = calculaColorSuave(alto);
-			x = (i % size);
-			y = (i / size);
-			for (int j = desdeY; j < desdeY + altoMapa; ++j){
-				for (int k = 0; k < grosor; ++k){
-					if (j < alto){
-						SetPixel(hdc, (desdeX + (grosor*x + k)), j, negro);
-					}
-					else{
-						SetPixel(hdc, (desdeX + (grosor*x + k)), j, color);
-					}
-				}
+		std::vector<int> altos(size);
+		std::vector<COLORREF> colores(size), grises(size);
+		lienzo.reserva(desdeX + grosor * size, desdeY + altoMapa + 1);
+		int desde, hasta;	// cada x pinta una columna de arriba a abajo (hasta 2*altoMapa por el gris de la altura)
+		if (!celdasVisibles(0, desdeY + 2 * altoMapa + 1, desdeX, grosor, desde, hasta)) return;
+		for (int y = 0; y < size; y++)
+		{
+			altosFila(y, desde, hasta, &altos[0]);
+			paleta.coloreaTerreno(&altos[desde], hasta - desde, &colores[desde]);
+			paleta.coloreaSuave(&altos[desde], hasta - desde, &grises[desde]);
+			for (int x = desde; x < hasta; x++){
+				alto = altos[x];
+				// Las filas de desdeY hasta alto van en negro, y desde alto hasta desdeY + altoMapa del color de la altura
+				int corte = (alto < desdeY) ? desdeY : ((alto > desdeY + altoMapa) ? desdeY + altoMapa : alto);
+				lienzo.rellenaRect(desdeX + grosor*x, desdeY, grosor, corte - desdeY, negro);
+				lienzo.rellenaRect(desdeX + grosor*x, corte, grosor, desdeY + altoMapa - corte, colores[x]);
+				lienzo.setPixel((desdeX + (grosor*x)), alto, grises[x]);
 			}
-			SetPixel(hdc, (desdeX + (grosor*x)), alto, colorS);
 		}
+		presenta(desdeX, 0, grosor * size, desdeY + altoMapa + 1);
 	}
 
 	/**
 	* Muestra una perspectiva rellena de izquierda a derecha (LR -- LeftToRight) del mapa.
 	* La llamada sin argumentos establece que se muestra desde el principio de la ventana, con un grosor de linea de 1
-	* (sin espaciado entre lineas)
+	* (sin espaciado entre lineas).
+	* Las tres perspectivas rellenas solo pintan lo que se ve, de delante a atras (ver pintaCorte3D()), asi que escriben
+	* menos pixeles que las Quick y sin dejar huecos
 	*/
 	void borrarCorte3DLR(){
-		mostrarCorte3DLR(0, 0, 1,RGB(0,0,0));
+		borrarCorte3DLR(0, 0, 1);
 	}
 	void borrarCorte3DLR(int grosor){
-		mostrarCorte3DLR(0, 0, grosor, RGB(0,0,0));
+		borrarCorte3DLR(0, 0, grosor);
 	}
 	void borrarCorte3DLR(int desdeX, int desdeY, int grosor){
-		mostrarCorte3DLR(desdeX, desdeY, grosor, RGB(0,0,0));
+		borraZonaVista(VISTA_3DLR, desdeX, desdeY, grosor, grosor);
 	}
 	void mostrarCorte3DLR(){
 		mostrarCorte3DLR(0, 0, 1,RGB(255,255,255));
@@ -544,47 +2183,13 @@ public:
 		mostrarCorte3DLR(desdeX, desdeY, grosor, RGB(255,255,255));
 	}
 	void mostrarCorte3DLR(int desdeX, int desdeY, int grosor, COLORREF c){
-		bool borrar = (c == RGB(0,0,0));	// Si el color a pasar es negro, es que quiero borrar
-		int x, y; 
-		COLORREF color, agua, gris;
-		int offset = -1;
-		int alto;
-		for (int i = 0; i < size*size; ++i)
-		{
-			if (i%size == 0){
-				offset++;
-			}
-			alto = calculaAlto(map[i]);
-			if(borrar){
-				color = c;
-				gris = c;
-				agua = c;
-			}
-			else{
-				color = calculaColor(alto);
-				gris = calculaColorSuave(alto);
-				agua = calculaColorAgua(alto);
-			}
-			
-			x = (i % size) * grosor;
-			y = (i / size);
-			if (alto > alturaAgua){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + ((x + k) + y)), (desdeY + alturaAgua + offset), agua);
-				}
-			}
-			for (int j = desdeY + alto; j < desdeY + altoMapa; ++j){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + ((x+k) +y)), (j + offset), color);
-				}
-			}
-			if (alto % 10 == 0){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + ((x + k) + y)), (desdeY + alto + offset), gris);
-				}
-			}
-			//SetPixel(hdc, (desdeX + (grosor*(x + y))), (desdeY + alto + offset), colorS);
-		}
+		MAPGEN_STAT(MedidaRepresentacion medida(this, "mostrarCorte3DLR");)
+		bool borrar = (c == RGB(0,0,0));
+		recuerdaVista(VISTA_3DLR, desdeX, desdeY, grosor, grosor, borrar);	// Si el color a pasar es negro, es que quiero borrar
+		int bx, by, bw, bh;
+		reservaCorte3D(desdeY, desdeX, 1, grosor, bx, by, bw, bh);
+		pintaCorte3D(getNivel(0), desdeY, desdeX, 1, grosor, c);
+		presenta(bx, by, bw, bh);
 	}
 
 	/**
@@ -593,13 +2198,13 @@ public:
 	* (sin espaciado entre puntos)
 	*/
 	void borrarCorte3DLRQuick(){
-		mostrarCorte3DLRQuick(0, 0, 1,RGB(0,0,0));
+		borrarCorte3DLRQuick(0, 0, 1);
 	}
 	void borrarCorte3DLRQuick(int grosor){
-		mostrarCorte3DLRQuick(0, 0, grosor, RGB(0,0,0));
+		borrarCorte3DLRQuick(0, 0, grosor);
 	}
 	void borrarCorte3DLRQuick(int desdeX, int desdeY, int grosor){
-		mostrarCorte3DLRQuick(desdeX,desdeY, grosor, RGB(0,0,0));
+		borraZonaVista(VISTA_3DLR_QUICK, desdeX, desdeY, grosor, grosor);
 	}
 	void mostrarCorte3DLRQuick(){
 		mostrarCorte3DLRQuick(0,0,1,RGB(255,255,255));
@@ -611,50 +2216,13 @@ public:
 		mostrarCorte3DLRQuick(desdeX,desdeY, grosor, RGB(255,255,255));
 	}
 	void mostrarCorte3DLRQuick(int desdeX, int desdeY, int grosor, COLORREF c){
+		MAPGEN_STAT(MedidaRepresentacion medida(this, "mostrarCorte3DLRQuick");)
 		bool borrar = (c == RGB(0,0,0));
-		int x, y;
-		COLORREF color, agua, gris;
-		int offset = -1;
-		int alto;
-		int end;
-		for (int i = 0; i < size*size; ++i)
-		{
-			if (i%size == 0){
-				offset++;
-			}
-			alto = calculaAlto(map[i]);
-			if(borrar){
-				color = c;
-				agua = c;
-				gris = c;
-			}
-			else{
-				color = calculaColor(alto);
-				gris = calculaColorSuave(alto);
-				agua = calculaColorAgua(alto);
-			}
-			x = (i % size) * grosor;
-			y = (i / size);
-			(x == 0) ? end = altoMapa : end = alto + 10;
-			if (alto > alturaAgua){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + ((x + k) + y)), (desdeY + alturaAgua + offset), agua);
-				}
-			}
-			for (int j = desdeY + alto; j < desdeY + end; ++j){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + ((x + k) + y)), (j + offset), color);
-				}
-			}
-			if (alto % 10 == 0){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + ((x + k) + y)), (desdeY + alto + offset), gris);
-				}
-			}
-			/*
-			* Notese que el for de la representacion rellena aqui desaparece, porque solo se pinta el punto de la posicion alto
-			*/
-		}
+		recuerdaVista(VISTA_3DLR_QUICK, desdeX, desdeY, grosor, grosor, borrar);
+		int bx, by, bw, bh;
+		reservaCorte3D(desdeY, desdeX, 1, grosor, bx, by, bw, bh);
+		pintaCorte3DQuick(desdeY, desdeX, 1, grosor, c, 0);
+		presenta(bx, by, bw, bh);
 	}
 
 	/**
@@ -663,13 +2231,13 @@ public:
 	* (sin espaciado entre lineas)
 	*/
 	void borrarCorte3DRL(){
-		mostrarCorte3DRL(0, 0, 1,RGB(0,0,0));
+		borrarCorte3DRL(0, 0, 1);
 	}
 	void borrarCorte3DRL(int grosor){
-		mostrarCorte3DRL(0, 0, grosor, RGB(0,0,0));
+		borrarCorte3DRL(0, 0, grosor);
 	}
 	void borrarCorte3DRL(int desdeX, int desdeY, int grosor){
-		mostrarCorte3DRL(desdeX, desdeY, grosor, RGB(0,0,0));
+		borraZonaVista(VISTA_3DRL, desdeX, desdeY, grosor, grosor);
 	}
 	void mostrarCorte3DRL(){
 		mostrarCorte3DRL(0, 0, 1, RGB(255,255,255));
@@ -681,46 +2249,13 @@ public:
 		mostrarCorte3DRL(desdeX, desdeY, grosor, RGB(255,255,255));
 	}
 	void mostrarCorte3DRL(int desdeX, int desdeY, int grosor, COLORREF c){
+		MAPGEN_STAT(MedidaRepresentacion medida(this, "mostrarCorte3DRL");)
 		bool borrar = (c == RGB(0,0,0));
-		int x, y;
-		COLORREF color, agua, gris;
-		int offset = -1;
-		int alto;
-		for (int i = 0; i < size*size; ++i)
-		{
-			if (i%size == 0){
-				offset++;
-			}
-			alto = calculaAlto(map[i]);
-			if(borrar){
-				color = c;
-				agua = c;
-				gris = c;
-			}
-			else{
-				color = calculaColor(alto);
-				agua = calculaColorAgua(alto);
-				gris = calculaColorSuave(alto);
-			}
-			x = (i % size) * grosor;
-			y = (i / size);
-
-			if (alto > alturaAgua){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + (size + x + k - y)), (desdeY + alturaAgua + offset), agua);
-				}
-			}
-			for (int j = desdeY + alto; j < desdeY + altoMapa; ++j){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + (size + x + k  - y)), (j + offset), color);
-				}
-			}
-			if(alto%10 == 0){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + (size + x + k - y)), (desdeY + alto + offset), gris);
-				}
-			}
-		}
+		recuerdaVista(VISTA_3DRL, desdeX, desdeY, grosor, grosor, borrar);
+		int bx, by, bw, bh;
+		reservaCorte3D(desdeY, desdeX + size, -1, grosor, bx, by, bw, bh);
+		pintaCorte3D(getNivel(0), desdeY, desdeX + size, -1, grosor, c);
+		presenta(bx, by, bw, bh);
 	}
 
 	/**
@@ -729,13 +2264,13 @@ public:
 	* (sin espaciado entre puntos)
 	*/
 	void borrarCorte3DRLQuick(){
-		mostrarCorte3DRLQuick(0, 0, 1,RGB(0,0,0));
+		borrarCorte3DRLQuick(0, 0, 1);
 	}
 	void borrarCorte3DRLQuick(int grosor){
-		mostrarCorte3DRLQuick(0, 0, grosor, RGB(0,0,0));
+		borrarCorte3DRLQuick(0, 0, grosor);
 	}
 	void borrarCorte3DRLQuick(int desdeX, int desdeY, int grosor){
-		mostrarCorte3DRLQuick(desdeX, desdeY, grosor, RGB(0,0,0));
+		borraZonaVista(VISTA_3DRL_QUICK, desdeX, desdeY, grosor, grosor);
 	}
 	void mostrarCorte3DRLQuick(){
 		mostrarCorte3DRLQuick(0,0,1, RGB(255,255,255));
@@ -747,46 +2282,13 @@ public:
 		mostrarCorte3DRLQuick(desdeX, desdeY, grosor, RGB(255,255,255));
 	}
 	void mostrarCorte3DRLQuick(int desdeX, int desdeY, int grosor, COLORREF c){
+		MAPGEN_STAT(MedidaRepresentacion medida(this, "mostrarCorte3DRLQuick");)
 		bool borrar = (c == RGB(0,0,0));
-		int x, y;
-		COLORREF color, agua, gris;
-		int offset = -1;
-		int alto;
-		int end;
-		for (int i = 0; i < size*size; ++i){
-			if (i%size == 0){
-				offset++;
-			}
-			alto = calculaAlto(map[i]);
-			if(borrar){
-				color = c;
-				agua = c;
-				gris = c;
-			}
-			else{
-				color = calculaColor(alto);
-				agua = calculaColorAgua(alto);
-				gris = calculaColorSuave(alto);
-			}
-			x = (i % size) * grosor;
-			y = (i / size);
-			(x == (size-1) * grosor) ? end = altoMapa : end = alto + 10;
-			if (alto > alturaAgua){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + (size + x + k - y)), (desdeY + alturaAgua + offset), agua);
-				}
-			}
-			for (int j = desdeY + alto; j < desdeY + end; ++j){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + (size + x + k - y)), (j + offset), color);
-				}
-			}
-			if (alto % 10 == 0){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + (size + x + k - y)), (desdeY + alto + offset), gris);
-				}
-			}
-		}
+		recuerdaVista(VISTA_3DRL_QUICK, desdeX, desdeY, grosor, grosor, borrar);
+		int bx, by, bw, bh;
+		reservaCorte3D(desdeY, desdeX + size, -1, grosor, bx, by, bw, bh);
+		pintaCorte3DQuick(desdeY, desdeX + size, -1, grosor, c, this->max);
+		presenta(bx, by, bw, bh);
 	}
 
 	/**
@@ -795,13 +2297,13 @@ public:
 	* (sin espaciado entre lineas)
 	*/
 	void borrarCorte3DFront(){
-		mostrarCorte3DFront(0, 0, 1,RGB(0,0,0));
+		borrarCorte3DFront(0, 0, 1);
 	}
 	void borrarCorte3DFront(int grosor){
-		mostrarCorte3DFront(0, 0, grosor, RGB(0,0,0));
+		borrarCorte3DFront(0, 0, grosor);
 	}
 	void borrarCorte3DFront(int desdeX, int desdeY, int grosor){
-		mostrarCorte3DFront(desdeX, desdeY, grosor, RGB(0,0,0));
+		borraZonaVista(VISTA_3DFRONT, desdeX, desdeY, grosor, grosor);
 	}
 	void mostrarCorte3DFront(){
 		mostrarCorte3DFront(0, 0, 1, RGB(255,255,255));
@@ -813,46 +2315,13 @@ public:
 		mostrarCorte3DFront(desdeX, desdeY, grosor, RGB(255,255,255));
 	}
 	void mostrarCorte3DFront(int desdeX, int desdeY, int grosor, COLORREF c){
+		MAPGEN_STAT(MedidaRepresentacion medida(this, "mostrarCorte3DFront");)
 		bool borrar = (c == RGB(0,0,0));
-		int x, y;
-		COLORREF color, agua, gris;
-		int offset = -1;
-		int alto;
-		for (int i = 0; i < size*size; ++i)
-		{
-			if (i%size == 0){
-				offset ++;
-			}
-			alto = calculaAlto(map[i]);
-			if(borrar){
-				color = c;
-				agua = c;
-				gris = c;
-			}
-			else{
-				color = calculaColor(alto);
-				agua = calculaColorAgua(alto);
-				gris = calculaColorSuave(alto);
-			}
-			x = (i % size) * grosor;
-			y = (i / size);
-
-			if (alto > alturaAgua){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + x + k), (desdeY + alturaAgua + offset), agua);
-				}
-			}
-			for (int j = desdeY + alto; j < desdeY + altoMapa; ++j){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + x + k), (j + offset), color);
-				}
-			}
-			if (alto % 10 == 0){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + x + k), (desdeY + alto + offset), gris);
-				}
-			}
-		}
+		recuerdaVista(VISTA_3DFRONT, desdeX, desdeY, grosor, grosor, borrar);
+		int bx, by, bw, bh;
+		reservaCorte3D(desdeY, desdeX, 0, grosor, bx, by, bw, bh);
+		pintaCorte3D(getNivel(0), desdeY, desdeX, 0, grosor, c);
+		presenta(bx, by, bw, bh);
 	}
 
 	/**
@@ -861,13 +2330,13 @@ public:
 	* (sin espaciado entre puntos)
 	*/
 	void borrarCorte3DFrontQuick(){
-		mostrarCorte3DFrontQuick(0, 0, 1,RGB(0,0,0));
+		borrarCorte3DFrontQuick(0, 0, 1);
 	}
 	void borrarCorte3DFrontQuick(int grosor){
-		mostrarCorte3DFrontQuick(0, 0, grosor, RGB(0,0,0));
+		borrarCorte3DFrontQuick(0, 0, grosor);
 	}
 	void borrarCorte3DFrontQuick(int desdeX, int desdeY, int grosor){
-		mostrarCorte3DFrontQuick(desdeX, desdeY, grosor, RGB(0,0,0));
+		borraZonaVista(VISTA_3DFRONT_QUICK, desdeX, desdeY, grosor, grosor);
 	}
 	void mostrarCorte3DFrontQuick(){
 		mostrarCorte3DFrontQuick(0,0,1,RGB(255,255,255));
@@ -879,46 +2348,52 @@ public:
 		mostrarCorte3DFrontQuick(desdeX, desdeY, grosor,RGB(255,255,255));
 	}
 	void mostrarCorte3DFrontQuick(int desdeX, int desdeY, int grosor, COLORREF c){
+		MAPGEN_STAT(MedidaRepresentacion medida(this, "mostrarCorte3DFrontQuick");)
 		bool borrar = (c == RGB(0,0,0));
-		int x, y;
-		COLORREF color, agua, gris;
-		int offset = -1;
-		int alto;
-		int end;
-		for (int i = 0; i < size*size; ++i)
-		{
-			if (i%size == 0){
-				offset ++;
-			}
-			alto = calculaAlto(map[i]);
-			if(borrar){
-				color = c;
-				agua = c;
-				gris = c;
-			}
-			else{
-				color = calculaColor(alto);
-				agua = calculaColorAgua(alto);
-				gris = calculaColorSuave(alto);
-			}
-			x = (i % size) * grosor;
-			y = (i / size);
-			if (alto > alturaAgua){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + x + k), (desdeY + alturaAgua + offset), agua);
+		recuerdaVista(VISTA_3DFRONT_QUICK, desdeX, desdeY, grosor, grosor, borrar);
+		int bx, by, bw, bh;
+		reservaCorte3D(desdeY, desdeX, 0, grosor, bx, by, bw, bh);
+		pintaCorte3DQuick(desdeY, desdeX, 0, grosor, c, -1);
+		presenta(bx, by, bw, bh);
+	}
+
+	/**
+	* Muestra en 2D, como mostrarVistaPlanta(), el nivel 'nivel' de la piramide de detalle (ver getNivel()): solo lee
+	* una de cada 2^nivel casillas en cada direccion, asi que sirve para ver el mapa de lejos sin recorrerlo entero.
+	* Durante la generacion (desde un ObservadorNiveles) higher y lower aun no estan, y los colores salen de la altura
+	* minima y maxima del propio nivel
+	*/
+	void mostrarNivel(int nivel, int desdeX, int desdeY, int pixelWidth, int pixelHeight){
+		MAPGEN_STAT(MedidaRepresentacion medida(this, "mostrarNivel");)
+		Nivel n = getNivel(nivel);
+		float menor = this->lower;
+		float mayor = this->higher;
+		if (this->generando){
+			menor = HUGE_VALF;
+			mayor = -HUGE_VALF;
+			for (int y = 0; y < n.lado; ++y){
+				for (int x = 0; x < n.lado; ++x){
+					float v = this->cuant.decodifica(n.get(x, y));
+					if (v < menor) menor = v;
+					if (v > mayor) mayor = v;
 				}
 			}
-			for (int j = desdeY + alto; j < desdeY + alto + 10; ++j){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + x + k), (j + offset), color);
-				}
+		}
+		int tamRangoAlturas = mayor - menor;
+		std::vector<int> altos(n.lado);
+		std::vector<COLORREF> colores(n.lado);
+		lienzo.reserva(desdeX + pixelWidth * n.lado, desdeY + pixelHeight * n.lado);
+		for (int y = 0; y < n.lado; ++y){
+			for (int x = 0; x < n.lado; ++x){
+				altos[x] = (tamRangoAlturas == 0) ? altoMapa :
+					(this->cuant.decodifica(n.get(x, y)) - menor) * altoMapa / tamRangoAlturas;
 			}
-			if (alto % 10 == 0){
-				for (int k = 0; k < grosor; ++k){
-					SetPixel(hdc, (desdeX + x + k), (desdeY + alto + offset), gris);
-				}
+			paleta.coloreaTerreno(&altos[0], n.lado, &colores[0]);
+			for (int x = 0; x < n.lado; ++x){
+				lienzo.rellenaRect(desdeX + pixelWidth * x, desdeY + pixelHeight * y, pixelWidth, pixelHeight, colores[x]);
 			}
 		}
+		presenta(desdeX, desdeY, pixelWidth * n.lado, pixelHeight * n.lado);
 	}
 
 	/**
@@ -929,54 +2404,138 @@ public:
 		mostrarEscala(0, 0);
 	}
 	void mostrarEscala(int desdeX, int desdeY){
+		MAPGEN_STAT(MedidaRepresentacion medida(this, "mostrarEscala");)
 		COLORREF color;
-		for (int i = desdeX; i < desdeX + 50; ++i)
-		{
-			for (int j = 0; j < altoMapa; ++j){
-				color = calculaColor(j);
-				SetPixel(hdc, i, (desdeY + j), color);
-				color = calculaColorSuave(j);
-				SetPixel(hdc, (i + 100), (desdeY + j), color);
-			}
+		lienzo.reserva(desdeX + 150, desdeY + altoMapa);
+		for (int j = 0; j < altoMapa; ++j){
+			color = paleta.getTerreno(j);
+			lienzo.rellenaRect(desdeX, desdeY + j, 50, 1, color);
+			color = paleta.getSuave(j);
+			lienzo.rellenaRect(desdeX + 100, desdeY + j, 50, 1, color);
 		}
+		presenta(desdeX, desdeY, 150, altoMapa);
 	}
 
 	/**
 	* Borra tanto los pixeles dibujados en la terminal, como los caracteres impresos con cout o similares
-	* Notese que para borrar pixeles, simplemente mueve la pantalla de sitio y la vuelve a colocar donde estaba
+	* El lienzo queda en negro y se vuelve a presentar entero. En Windows el texto de la consola se borra rellenando su
+	* buffer con espacios (sin lanzar "cls" en otro proceso); para borrar pixeles, ademas, mueve la pantalla de sitio y
+	* la vuelve a colocar donde estaba
 	* borrar() no funciona si la terminal se ha movido de su posicion original (aun no se porque)
+	* Para borrar solo una representacion estan borrarVista() y los borrar* de cada una
 	*/
 	void borrar(){
-		system("cls");
+		lienzo.limpia();
+		this->vista.tipo = VISTA_NINGUNA;
+#ifdef _WIN32
+		HANDLE consola = GetStdHandle(STD_OUTPUT_HANDLE);
+		CONSOLE_SCREEN_BUFFER_INFO info;
+		if (GetConsoleScreenBufferInfo(consola, &info)){
+			COORD origen = { 0, 0 };
+			DWORD celdas = (DWORD)info.dwSize.X * info.dwSize.Y;
+			DWORD escritas;
+			FillConsoleOutputCharacter(consola, ' ', celdas, origen, &escritas);
+			FillConsoleOutputAttribute(consola, info.wAttributes, celdas, origen, &escritas);
+			SetConsoleCursorPosition(consola, origen);
+		}
 		WINDOWPLACEMENT oldPos;
 		GetWindowPlacement(GetConsoleWindow(), &oldPos);
 		SetWindowPlacement(GetConsoleWindow(), &oldPos);
+#endif
+		presenta(0, 0, lienzo.getAncho(), lienzo.getAlto());
 	}
 
 	/**
-	* Devuelve el valor mas alto del mapa
+	* Borra la ultima representacion mostrada, sin tocar el resto del lienzo: deja en negro, de un solo rellenaRect(), la
+	* zona que se apunto al pintarla (ver borraZonaVista()), aunque despues haya cambiado el mapa o altoMapa.
+	* Si no hay vista (nunca se ha mostrado, o ya se ha borrado), no hace nada
 	*/
-	float findHigher(){
-		float mayor = 0;
-		for (int i = 0; i < this->size*this->size; ++i){
-			if (map[i] > mayor){
-				mayor = map[i];
+	void borrarVista(){
+		if (this->vista.tipo == VISTA_NINGUNA) return;
+		Vista &v = this->vista;
+		v.tipo = VISTA_NINGUNA;
+		this->sucios.clear();
+		this->todoSucio = false;
+		lienzo.rellenaRect(v.x, v.y, v.ancho, v.alto, RGB(0, 0, 0));
+		presenta(v.x, v.y, v.ancho, v.alto);
+	}
+
+	/**
+	* Guarda las alturas del mapa en un fichero con el formato dado (ver FormatoAlturas en Export.hpp): floats de 32 bits
+	* sin cabecera, o PGM/PNG de 16 bits en los que lower es 0 y higher 65535.
+	* Se escribe fila a fila directamente desde la matriz del mapa, sin copiar el mapa entero.
+	* Devuelve false si no se ha podido escribir
+	*/
+	bool guardaAlturas(const char *ruta, FormatoAlturas formato){
+		return guardaAlturas(ruta, formato, 0, 0, this->size, this->size);
+	}
+
+	/**
+	* Igual, pero solo el rectangulo de ancho x alto casillas que empieza en la casilla (x0, y0). Lo que se salga del mapa
+	* no se guarda; si no queda nada, devuelve false
+	*/
+	bool guardaAlturas(const char *ruta, FormatoAlturas formato, int x0, int y0, int ancho, int alto){
+		if (!recortaRect(x0, y0, ancho, alto)) return false;
+		EscritorAlturas escritor;
+		if (!escritor.abre(ruta, formato, ancho, alto, this->lower, this->higher)) return false;
+		std::vector<float> fila(ancho);
+		for (int y = y0; y < y0 + alto; ++y){
+			const Sample *casillas = this->map + x0 + this->size * y;
+			for (int x = 0; x < ancho; ++x){
+				fila[x] = this->cuant.decodifica(casillas[x]);
 			}
+			if (!escritor.fila(&fila[0])) return false;
 		}
-		return mayor;
+		return escritor.cierra();
 	}
 
 	/**
-	* Devuelve el valor mas bajo del mapa (Puede ser menor que 0)
+	* Guarda el mapa como un PNG en color, con una casilla por pixel y los colores de la paleta (por defecto, los de
+	* calculaColor()): los de la vista en planta, salvo las casillas de alto mayor que alturaAgua, que van con el color
+	* del agua como en los cortes 3D. Se escribe fila a fila, sin pasar por el lienzo.
+	* Devuelve false si no se ha podido escribir
 	*/
-	float findLower(){
-		float menor = size;
-		for (int i = 0; i < this->size*this->size; ++i){
-			if (map[i] < menor){
-				menor = map[i];
+	bool guardaColor(const char *ruta){
+		return guardaColor(ruta, 0, 0, this->size, this->size);
+	}
+
+	/**
+	* Igual, pero solo el rectangulo de ancho x alto casillas que empieza en la casilla (x0, y0), recortado al mapa
+	*/
+	bool guardaColor(const char *ruta, int x0, int y0, int ancho, int alto){
+		if (!recortaRect(x0, y0, ancho, alto)) return false;
+		EscritorPNG png;
+		if (!png.abre(ruta, ancho, alto, 8, true)) return false;
+		std::vector<int> altos(this->size);
+		std::vector<COLORREF> colores(this->size);
+		std::vector<uint8_t> rgb((size_t)ancho * 3);
+		for (int y = y0; y < y0 + alto; ++y){
+			altosFila(y, x0, x0 + ancho, &altos[0]);
+			paleta.coloreaTerreno(&altos[x0], ancho, &colores[x0]);
+			for (int x = 0; x < ancho; ++x){
+				int a = altos[x0 + x];
+				COLORREF c = (a > alturaAgua) ? paleta.getAgua(a) : colores[x0 + x];
+				rgb[3 * x] = GetRValue(c);
+				rgb[3 * x + 1] = GetGValue(c);
+				rgb[3 * x + 2] = GetBValue(c);
 			}
+			if (!png.fila(&rgb[0])) return false;
 		}
-		return menor;
+		return png.cierra();
+	}
+
+	/**
+	* Devuelve el valor mas alto del mapa
+	*/
+	float findHigher(){
+		return buscaLimites().mayor;
+	}
+
+	/**
+	* Devuelve el valor mas bajo del mapa (Puede ser menor que 0)
+	*/
+	float findLower(){
+		return buscaLimites().menor;
 	}
 
 	/**
@@ -986,6 +2545,198 @@ public:
 		return this->seed;
 	}
 
+	/**
+	* Devuelve el lado de la matriz de alturas ((2^detalle) + 1)
+	*/
+	int getSize() const {
+		return this->size;
+	}
+
+	/**
+	* Devuelve la matriz de alturas (size x size, la casilla (x,y) esta en la posicion x + size*y), en el tipo de muestra
+	* del mapa (para pasarlas a float, ver getCuantizacion())
+	*/
+	const Sample* getHeights() const {
+		return this->map;
+	}
+
+	/**
+	* Devuelve la cuantizacion con la que estan guardadas las alturas de getHeights()
+	*/
+	const Cuantizacion<Sample>& getCuantizacion() const {
+		return this->cuant;
+	}
+
+	/**
+	* Numero de niveles de la piramide de detalle (detalle + 1)
+	*/
+	int getNiveles() const {
+		return numNiveles();
+	}
+
+	/**
+	* Devuelve el nivel 'nivel' de la piramide de detalle: una de cada 2^nivel casillas del mapa en cada direccion.
+	* Con la piramide activada (ver setPiramide()) es una copia compacta (paso 1, filas seguidas); si no, es una vista con
+	* saltos sobre la propia matriz del mapa. En los dos casos deja de valer si se vuelve a generar el mapa o se desactiva
+	* la piramide
+	*/
+	Nivel getNivel(int nivel) const {
+		int niveles = numNiveles();
+		nivel = (nivel < 0) ? 0 : ((nivel >= niveles) ? niveles - 1 : nivel);
+		Nivel n;
+		n.escala = 1 << nivel;
+		n.lado = this->max / n.escala + 1;
+		if (nivel > 0 && this->conPiramide){
+			n.alturas = &this->piramide[nivel][0];
+			n.paso = 1;
+			n.fila = n.lado;
+		}
+		else {
+			n.alturas = this->map;
+			n.paso = n.escala;
+			n.fila = (size_t)this->size * n.escala;
+		}
+		return n;
+	}
+
+	/**
+	* Devuelve el nivel mas basto que tiene al menos 'lado' alturas por lado (el 0 si ninguno llega), para pintar el mapa
+	* en lado x lado pixeles
+	*/
+	int nivelParaLado(int lado) const {
+		int nivel = 0;
+		while (nivel + 1 < numNiveles() && this->max / (1 << (nivel + 1)) + 1 >= lado) ++nivel;
+		return nivel;
+	}
+
+	/**
+	* Activa (o desactiva) las copias compactas de los niveles de la piramide. Activada, cada nivel se copia en cuanto se
+	* termina de generar, y los sectores modificados se copian despues de cada modificacion. Ocupa un tercio mas que el
+	* mapa. Si se activa con el mapa ya generado, se copian ahora
+	*/
+	void setPiramide(bool activa){
+		if (activa == this->conPiramide) return;
+		this->conPiramide = activa;
+		if (!activa){
+			std::vector<std::vector<Sample> >().swap(this->piramide);
+			return;
+		}
+		this->piramide.resize(numNiveles());
+		for (int nivel = 1; nivel < (int)this->piramide.size(); ++nivel){
+			int lado = this->max / (1 << nivel) + 1;
+			this->piramide[nivel].resize((size_t)lado * lado);
+			copiaNivel(nivel, 0, 0, this->max, this->max);
+		}
+	}
+
+	/**
+	* Pone el observador que recibe cada nivel de la piramide en cuanto se termina de generar, del mas basto (nivel
+	* getNiveles()-1, las esquinas) al 0 (ver ObservadorNiveles). Con NULL no se avisa a nadie
+	*/
+	void setObservadorNiveles(ObservadorNiveles *observador){
+		this->observador = observador;
+	}
+
+	/**
+	* Devuelve el lienzo (framebuffer) sobre el que pintan los metodos mostrar*
+	*/
+	FrameBuffer& getFrameBuffer(){
+		return this->lienzo;
+	}
+
+	/**
+	* Cambia el destino al que se vuelca el lienzo tras cada representacion. Con NULL no se vuelca a ningun sitio
+	* (util para generar imagenes sin ventana, p.ej. en un servidor)
+	*/
+	void setRenderSink(RenderSink *salida){
+		this->salida = salida;
+	}
+
+	/**
+	* Cambia el numero de hilos con que se pintan las vistas (0 para usar todos los nucleos, que es lo que se hace por
+	* defecto). Las vistas pequenas se pintan igualmente en un solo hilo, y el resultado es el mismo con cualquier
+	* numero de hilos
+	*/
+	void setHilosRepresentacion(int hilos){
+		this->hilosRepresentacion = hilos;
+	}
+
+	int getHilosRepresentacion() const {
+		return this->hilosRepresentacion;
+	}
+
+	/**
+	* Cambia el alto maximo (en pixeles) con que se representan las alturas. Como minimo 7 (una capa de color por
+	* cada septimo). alturaAgua se queda por debajo de altoMapa
+	*/
+	void setAltoMapa(int altoMapa){
+		this->altoMapa = (altoMapa < 7) ? 7 : altoMapa;
+		if (this->alturaAgua >= this->altoMapa) this->alturaAgua = this->altoMapa - 1;
+		construyePaleta();
+		this->todoSucio = true;
+	}
+
+	/**
+	* Cambia el nivel del agua (0 es el mas alto, altoMapa no habria agua), entre 0 y altoMapa-1
+	*/
+	void setAlturaAgua(int alturaAgua){
+		this->alturaAgua = (alturaAgua < 0) ? 0 : ((alturaAgua >= altoMapa) ? altoMapa - 1 : alturaAgua);
+		construyePaleta();
+		this->todoSucio = true;
+	}
+
+	int getAltoMapa() const {
+		return this->altoMapa;
+	}
+
+	int getAlturaAgua() const {
+		return this->alturaAgua;
+	}
+
+	/**
+	* Usa una paleta propia en vez de la de por defecto (ver Palette.hpp). Se mantiene aunque cambien altoMapa o
+	* alturaAgua, hasta que se llame a restauraPaleta()
+	*/
+	void setPaleta(const Paleta &paleta){
+		this->paleta = paleta;
+		this->paletaPropia = true;
+		this->todoSucio = true;
+	}
+
+	/**
+	* Vuelve a la paleta por defecto
+	*/
+	void restauraPaleta(){
+		this->paletaPropia = false;
+		construyePaleta();
+		this->todoSucio = true;
+	}
+
+	const Paleta& getPaleta() const {
+		return this->paleta;
+	}
+
+#ifdef MAPGEN_STATS
+	/**
+	* Devuelve lo medido en la ultima generacion y en las representaciones hechas desde limpiaEstadisticas()
+	* (solo compilando con MAPGEN_STATS, ver Stats.hpp)
+	*/
+	const Estadisticas& getEstadisticas() const {
+		return this->estadisticas;
+	}
+
+	void limpiaEstadisticas(){
+		this->estadisticas.limpia();
+	}
+
+	/**
+	* Guarda las estadisticas como trazas (trace events JSON, para chrome://tracing o Perfetto)
+	*/
+	bool guardaTraza(const char *ruta) const {
+		return this->estadisticas.guardaTraza(ruta);
+	}
+#endif
+
 	/**
 	* Referido a las distintas persepectivas desde las que se puede ver el mapa
 	* De izquierda a derecha, frontalmente, o de derecha a izquierda
@@ -996,12 +2747,53 @@ public:
 		RL
 	};
 
-	// TO-DO
+	/**
+	* Devuelve el nivel de la piramide de detalle (ver getNivel()) con el que muestraMapa() pinta el mapa en una ventana
+	* de limitX x limitY pixeles: el mas fino que cabe a lo ancho (grosor pixeles por casilla, y en LR y RL un pixel mas
+	* por fila, que se van desplazando) y a lo alto (un pixel por fila, y altoMapa mas por debajo si la ventana da para
+	* ello). Si no cabe ninguno, el ultimo
+	*/
+	int nivelParaVentana(int grosor, Pers perspectiva, int limitX, int limitY) const {
+		if (grosor <= 0) return 0;
+		int casillas = (perspectiva == FRONT) ? limitX / grosor : (limitX + 1) / (grosor + 1);
+		int filas = (limitY > altoMapa) ? limitY - altoMapa + 1 : limitY;
+		if (filas < casillas) casillas = filas;
+		int nivel = 0;
+		while (nivel + 1 < numNiveles() && (this->max >> nivel) + 1 > casillas) ++nivel;
+		return nivel;
+	}
 
 	/**
-	* Muestra el mapa desde la posicion indicada, con un grosor dado, desde la perspectiva indicada, y hasta los limites dados
+	* Muestra el mapa desde la posicion indicada, con un grosor dado, desde la perspectiva indicada, y hasta los limites dados:
+	* lo mismo que mostrarCorte3DLR(), mostrarCorte3DFront() o mostrarCorte3DRL(), pero dentro de la ventana de
+	* limitX x limitY pixeles que empieza en (desdeX, desdeY). Si el mapa tiene mas casillas que pixeles la ventana, se
+	* pinta un nivel mas basto de la piramide de detalle (ver nivelParaVentana()), y lo que aun se salga de la ventana se
+	* recorta antes de leer sus alturas, asi que cuesta lo que la ventana y no lo que el mapa.
+	* No cambia la ultima vista (ver actualizaVista())
 	*/
 	void muestraMapa(int desdeX, int desdeY, int grosor, Pers perspectiva, int limitX, int limitY){
+		MAPGEN_STAT(MedidaRepresentacion medida(this, "muestraMapa");)
+		if (grosor <= 0 || limitX <= 0 || limitY <= 0) return;
+		Nivel n = getNivel(nivelParaVentana(grosor, perspectiva, limitX, limitY));
+		int x0 = (perspectiva == RL) ? desdeX + n.lado : desdeX;
+		int dx = (perspectiva == LR) ? 1 : ((perspectiva == FRONT) ? 0 : -1);
+		// se presenta la caja entera de la vista (calculaAlto() puede pasarse de altoMapa), dentro de la ventana
+		int bx, by, ancho, alto;
+		extensionCorte3D(n, desdeY, x0, dx, grosor, bx, by, ancho, alto);
+		if (bx + ancho > desdeX + limitX) ancho = desdeX + limitX - bx;
+		if (alto > limitY) alto = limitY;
+		lienzo.reserva(bx + ancho, by + alto);
+		// la ventana se pinta recortada (dentro del recorte que ya hubiera), que es lo que deja leer solo lo que se ve
+		int rx0, ry0, rx1, ry1;
+		bool recortado = lienzo.getRecorte(rx0, ry0, rx1, ry1);
+		int x = desdeX, y = desdeY, w = limitX, h = limitY;
+		if (lienzo.recorta(x, y, w, h)){
+			lienzo.fijaRecorte(x, y, w, h);
+			pintaCorte3D(n, desdeY, x0, dx, grosor, RGB(255, 255, 255));
+			if (recortado) lienzo.fijaRecorte(rx0, ry0, rx1 - rx0, ry1 - ry0);
+			else lienzo.quitaRecorte();
+		}
+		presenta(bx, by, ancho, alto);
 	}
 
 	/**
@@ -1010,31 +2802,145 @@ public:
 	* Solo se pueden modificar sectores cuyo lado sea una potencia de dos, ya que el algoritmo Diamond-Square solo actua en 
 	* matrices de lado (2^n + 1)
 	* No se haran sobre matrices de menos de lado 3.
+	* En Map16 el rango de la cuantizacion se fija al generar: si la edicion se puede salir de el (centralHeight fuera
+	* del rango, o mucho roughness), antes se amplia y se vuelve a codificar el mapa (ver cuantizacionPara())
 	*
 	* LA FUNCION ESTA IMPLEMENTADA, PERO PROVOCA CAMBIOS MUY BRUSCOS EN EL TERRENO, CONVIENE REVISARLO
 	*/
 	void modificaSector(int origX, int origY, int lado, float roughness, float centralHeight){
-		if (origX >= 0 && origX < size && origY >= 0 && origY < size){
-			int tam = pow(2, lado) + 1;
-			int destX = origX + tam;
-			int destY = origY + tam;
-			if (destX >= 0 && destX < size && destY >= 0 && destY < size){
-				Map* modified = new Map(lado);
-				for (int i = origX, iM = 0; i < destX; ++i, ++iM){
-					for (int j = origY, jM = 0; j < destY; ++j, ++jM){
-						modified->set(iM, jM, this->get(i, j));
-					}
-				}
-				modified->generateSector(roughness,centralHeight);
-				for (int i = origX, iM = 0; i < destX; ++i, ++iM){
-					for (int j = origY, jM = 0; j < destY; ++j, ++jM){
-						float l = modified->get(iM, jM);
-						this->set(i, j, l);
-					}
+		if (soloLectura()) return;
+		int tam = tamSector(origX, origY, lado);
+		if (tam == 0) return;
+		Limites rango;
+		rangoEdicion(origX, origY, tam, roughness, centralHeight, rango);
+		cuantizacionPara(rango);
+		Limites antes;		// limites del sector antes de modificarlo
+		Limites despues;	// y despues
+		// El sector se regenera en su sitio, con su propio generador, de semilla sacada del de este mapa
+		regeneraSector(origX, origY, tam, roughness, centralHeight, this->rng.next(), antes, despues);
+		// higher y lower se actualizan solo con el sector, sin recorrer el mapa (salvo que haga falta)
+		actualizaLimites(antes, despues);
+		sectorModificado(origX, origY, tam);
+	}
+
+	/**
+	* Hace todas las ediciones de la lista, con el mismo resultado que llamando a modificaSector() con cada una, en orden
+	* (las que no caben en el mapa se ignoran). Las ediciones que no se pisan entre si se hacen a la vez, repartidas
+	* entre 'threads' hilos (con threads <= 0 se usan todos los nucleos); las que se pisan se hacen siempre en el orden de
+	* la lista (ver reparteOleadas()). higher y lower se actualizan una sola vez, al final.
+	* Con RandGlobal (que no puede usarse desde varios hilos) las ediciones se hacen todas en el hilo que llama
+	*/
+	void modificaSectores(const std::vector<EdicionSector> &ediciones, int threads = 0){
+		if (soloLectura()) return;
+		if (threads <= 0) threads = std::thread::hardware_concurrency();
+		if (!EstadoPropio<Rng>::valor) threads = 1;
+		Limites antes;
+		Limites despues;
+		if (threads == 1){
+			for (size_t i = 0; i < ediciones.size(); ++i){
+				const EdicionSector &e = ediciones[i];
+				int tam = tamSector(e.origX, e.origY, e.lado);
+				if (tam == 0) continue;
+				Limites rango;
+				rangoEdicion(e.origX, e.origY, tam, e.roughness, e.centralHeight, rango);
+				cuantizacionPara(rango);
+				regeneraSector(e.origX, e.origY, tam, e.roughness, e.centralHeight, this->rng.next(), antes, despues);
+				sectorModificado(e.origX, e.origY, tam);
+			}
+			actualizaLimites(antes, despues);
+			return;
+		}
+		/*
+		* Las semillas se sacan del generador del mapa en el orden de la lista, igual que si se llamara a modificaSector()
+		* con cada edicion. Como cada sector usa su propio generador, da igual en que hilo o en que orden se hagan despues
+		*/
+		std::vector<int> tams(ediciones.size());
+		std::vector<uint32_t> semillas(ediciones.size());
+		for (size_t i = 0; i < ediciones.size(); ++i){
+			tams[i] = tamSector(ediciones[i].origX, ediciones[i].origY, ediciones[i].lado);
+			if (tams[i] > 0) semillas[i] = this->rng.next();
+		}
+		std::vector<std::vector<int> > oleadas = reparteOleadas(ediciones, tams);
+		std::mutex cerrojo;
+		for (size_t o = 0; o < oleadas.size(); ++o){
+			const std::vector<int> &oleada = oleadas[o];
+			long long casillas = 0;
+			Limites rango;	// las ediciones de una oleada no se pisan: sus esquinas no las cambia ninguna otra de ella
+			for (size_t k = 0; k < oleada.size(); ++k){
+				const EdicionSector &e = ediciones[oleada[k]];
+				casillas += (long long)tams[oleada[k]] * tams[oleada[k]];
+				rangoEdicion(e.origX, e.origY, tams[oleada[k]], e.roughness, e.centralHeight, rango);
+			}
+			cuantizacionPara(rango);	// antes de crear los mapas de trabajo, que copian la cuantizacion
+			// Cada hilo (tambien el que llama) trabaja con su propio mapa de trabajo, asi este no cambia mientras tanto
+			enParalelo((int)oleada.size(), (int)(casillas / oleada.size()), threads, [&](int desde, int hasta){
+				BasicMap trabajador(this);
+				Limites a, d;	// cada hilo recoge los suyos, y al terminar se juntan
+				for (int k = desde; k < hasta; ++k){
+					const EdicionSector &e = ediciones[oleada[k]];
+					trabajador.regeneraSector(e.origX, e.origY, tams[oleada[k]], e.roughness, e.centralHeight,
+						semillas[oleada[k]], a, d);
 				}
-				delete modified;
+				std::lock_guard<std::mutex> bloqueo(cerrojo);
+				antes.junta(a);
+				despues.junta(d);
+			});
+		}
+		actualizaLimites(antes, despues);
+		for (size_t i = 0; i < ediciones.size(); ++i){
+			if (tams[i] > 0) sectorModificado(ediciones[i].origX, ediciones[i].origY, tams[i]);
+		}
+	}
+
+	/**
+	* Vuelve a pintar la ultima vista mostrada (con el mismo metodo y los mismos parametros), pero solo la zona del lienzo
+	* que ha cambiado con los sectores modificados desde entonces (ver modificaSector() y modificaSectores()): en la
+	* vista de planta, el rectangulo del sector; en las vistas 3D, el paralelogramo en el que se proyecta el sector,
+	* con todas las columnas de las casillas de delante y de detras que se pintan en el; en mostrarCorte(), sus columnas.
+	* Esa zona se borra (a negro) y se vuelven a pintar, recortadas a ella, todas las casillas que pintan dentro.
+	* Si el lienzo ya tenia un recorte (ver getFrameBuffer()), las zonas se recortan tambien a el, y se deja como estaba.
+	* Si ha cambiado la escala de colores (higher o lower, altoMapa, alturaAgua o la paleta) o se ha vuelto a generar el
+	* mapa, se borra y se vuelve a pintar la vista entera. Si no hay vista (nunca se ha mostrado, o se ha borrado), no
+	* hace nada
+	*/
+	void actualizaVista(){
+		if (this->vista.tipo == VISTA_NINGUNA) return;
+		Vista v = this->vista;
+		if (this->todoSucio || v.higher != this->higher || v.lower != this->lower){
+			lienzo.rellenaRect(v.x, v.y, v.ancho, v.alto, RGB(0, 0, 0));
+			pintaVista(v);
+			const Vista &nueva = this->vista;
+			if (v.x < nueva.x || v.y < nueva.y || v.x + v.ancho > nueva.x + nueva.ancho || v.y + v.alto > nueva.y + nueva.alto){
+				presenta(v.x, v.y, v.ancho, v.alto);	// lo borrado se sale de la vista nueva (p.ej. con menos altoMapa)
 			}
+			return;
+		}
+		std::vector<RectCasillas> zonas;
+		zonas.swap(this->sucios);
+		// cada zona se pinta recortada a ella, dentro del recorte que ya hubiera (que se deja como estaba)
+		int rx0, ry0, rx1, ry1;
+		bool recortado = lienzo.getRecorte(rx0, ry0, rx1, ry1);
+		for (size_t i = 0; i < zonas.size(); ++i){
+			int x, y, ancho, alto;
+			zonaVista(v, zonas[i], x, y, ancho, alto);
+			if (!lienzo.recorta(x, y, ancho, alto)) continue;
+			lienzo.fijaRecorte(x, y, ancho, alto);
+			lienzo.rellenaRect(x, y, ancho, alto, RGB(0, 0, 0));
+			pintaVista(v);
+			if (recortado) lienzo.fijaRecorte(rx0, ry0, rx1 - rx0, ry1 - ry0);
+			else lienzo.quitaRecorte();
 		}
 	}
 
-};
\ No newline at end of file
+};
+
+/**
+* Mapa con alturas en float y el generador por defecto (xoshiro128+)
+*/
+typedef BasicMap<> Map;
+
+/**
+* Mapas con alturas de 16 bits: half-float, y punto fijo
+*/
+typedef BasicMap<Half> MapHalf;
+typedef BasicMap<uint16_t> Map16;
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include "FrameBuffer.hpp"
+
+/**
+* Paleta de colores de un mapa: para cada valor de alto (la altura representativa, entre 0 y altoMapa, ver
+* Map::calculaAlto()) guarda el color del terreno, el gris suave (lineas de nivel y mostrarCorte()) y el color del agua.
+* Los representadores no calculan colores, solo los buscan aqui, asi que la paleta se calcula una sola vez (por defecto,
+* cada vez que cambia altoMapa o alturaAgua, ver Map::construyePaleta()) en lugar de una vez por casilla y dibujo.
+*
+* Se puede construir una paleta propia (ver Map::setPaleta()) con cualquier numero de entradas: la entrada i es el color
+* del alto i, y los altos que se salen de la tabla usan la primera o la ultima entrada.
+*/
+class Paleta {
+private:
+	std::vector<COLORREF> terreno;
+	std::vector<COLORREF> suave;
+	std::vector<COLORREF> agua;
+
+	int limita(int alto) const {
+		int ultima = (int)terreno.size() - 1;
+		return (alto < 0) ? 0 : ((alto > ultima) ? ultima : alto);
+	}
+
+	/**
+	* dst[i] = tabla[altos[i]] para toda la fila. Es un bucle sin saltos (solo la busqueda en la tabla), que el
+	* compilador puede vectorizar con gather
+	*/
+	void colorea(const std::vector<COLORREF> &tabla, const int *altos, int n, COLORREF *dst) const {
+		const COLORREF *t = &tabla[0];
+		int ultima = (int)tabla.size() - 1;
+		for (int i = 0; i < n; ++i){
+			int alto = altos[i];
+			alto = (alto < 0) ? 0 : alto;
+			alto = (alto > ultima) ? ultima : alto;
+			dst[i] = t[alto];
+		}
+	}
+
+public:
+
+	/**
+	* Crea una paleta de 'entradas' altos (como minimo 1), toda en negro
+	*/
+	Paleta(int entradas = 1){
+		if (entradas < 1) entradas = 1;
+		terreno.assign(entradas, RGB(0, 0, 0));
+		suave.assign(entradas, RGB(0, 0, 0));
+		agua.assign(entradas, RGB(0, 0, 0));
+	}
+
+	int getEntradas() const {
+		return (int)terreno.size();
+	}
+
+	COLORREF getTerreno(int alto) const {
+		return terreno[limita(alto)];
+	}
+
+	COLORREF getSuave(int alto) const {
+		return suave[limita(alto)];
+	}
+
+	COLORREF getAgua(int alto) const {
+		return agua[limita(alto)];
+	}
+
+	/**
+	* Cambian el color de un alto (que tiene que estar entre 0 y getEntradas()-1)
+	*/
+	void setTerreno(int alto, COLORREF color){
+		terreno[limita(alto)] = color;
+	}
+
+	void setSuave(int alto, COLORREF color){
+		suave[limita(alto)] = color;
+	}
+
+	void setAgua(int alto, COLORREF color){
+		agua[limita(alto)] = color;
+	}
+
+	/**
+	* Colores del terreno (o grises suaves) de una fila entera de altos
+	*/
+	void coloreaTerreno(const int *altos, int n, COLORREF *dst) const {
+		colorea(terreno, altos, n, dst);
+	}
+
+	void coloreaSuave(const int *altos, int n, COLORREF *dst) const {
+		colorea(suave, altos, n, dst);
+	}
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+* Generadores de numeros aleatorios que puede usar un mapa (BasicMap<Rng>). Cada mapa tiene el suyo propio, asi que
+* dos mapas del mismo proceso no se pisan la secuencia el uno al otro.
+*
+* Todos siguen la misma forma:
+*	Rng(uint32_t seed)				crea el generador a partir de una semilla
+*	uint32_t next()					devuelve 32 bits aleatorios
+*	float nextFloat()				devuelve un float entre 0 y 1
+*	void fill(float *dst, int n)	rellena dst con n floats entre 0 y 1, de una sola vez
+*/
+
+/**
+* Expande una semilla de 32 bits en valores de 64 bits bien repartidos (SplitMix64), para inicializar el estado de los
+* generadores
+*/
+inline uint64_t splitMix64(uint64_t &estado){
+	uint64_t z = (estado += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+/**
+* Pasa 32 bits aleatorios a un float entre 0 y 1 (sin llegar a 1), con los 24 bits altos
+*/
+inline float bitsToFloat(uint32_t bits){
+	return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+/**
+* xoshiro128+ (Blackman y Vigna). Muy rapido y con 128 bits de estado. Es el generador por defecto
+*/
+class Xoshiro128Plus {
+private:
+	uint32_t s[4];
+
+	static uint32_t rotl(uint32_t x, int k){
+		return (x << k) | (x >> (32 - k));
+	}
+
+public:
+	Xoshiro128Plus(uint32_t seed = 0){
+		uint64_t estado = seed;
+		uint64_t a = splitMix64(estado);
+		uint64_t b = splitMix64(estado);
+		s[0] = (uint32_t)a;
+		s[1] = (uint32_t)(a >> 32);
+		s[2] = (uint32_t)b;
+		s[3] = (uint32_t)(b >> 32);
+	}
+
+	uint32_t next(){
+		uint32_t resultado = s[0] + s[3];
+		uint32_t t = s[1] << 9;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 11);
+		return resultado;
+	}
+
+	float nextFloat(){
+		return bitsToFloat(next());	// los bits bajos de xoshiro128+ son los mas flojos, bitsToFloat() usa los altos
+	}
+
+	void fill(float *dst, int n){
+		for (int i = 0; i < n; ++i){
+			dst[i] = bitsToFloat(next());
+		}
+	}
+};
+
+/**
+* PCG32 (O'Neill), variante XSH-RR con 64 bits de estado
+*/
+class Pcg32 {
+private:
+	uint64_t estado;
+	uint64_t incremento;
+
+public:
+	Pcg32(uint32_t seed = 0){
+		uint64_t semilla = seed;
+		this->incremento = (splitMix64(semilla) << 1) | 1;
+		this->estado = 0;
+		next();
+		this->estado += splitMix64(semilla);
+		next();
+	}
+
+	uint32_t next(){
+		uint64_t anterior = estado;
+		estado = anterior * 6364136223846793005ull + incremento;
+		uint32_t xorshifted = (uint32_t)(((anterior >> 18) ^ anterior) >> 27);
+		uint32_t rot = (uint32_t)(anterior >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+	}
+
+	float nextFloat(){
+		return bitsToFloat(next());
+	}
+
+	void fill(float *dst, int n){
+		for (int i = 0; i < n; ++i){
+			dst[i] = bitsToFloat(next());
+		}
+	}
+};
+
+/**
+* Philox4x32-10 (Salmon et al., Random123). Es un generador basado en contador: cada bloque de 4 valores es una
+* funcion del contador y la clave (la semilla), asi que saltar a cualquier punto de la secuencia es inmediato
+*/
+class Philox4x32 {
+private:
+	uint32_t contador[4];
+	uint32_t clave[2];
+	uint32_t bloque[4];
+	int usados;		// cuantos valores de bloque se han devuelto ya
+
+	static void ronda(uint32_t c[4], const uint32_t k[2]){
+		uint64_t p0 = (uint64_t)0xD2511F53u * c[0];
+		uint64_t p1 = (uint64_t)0xCD9E8D57u * c[2];
+		uint32_t hi0 = (uint32_t)(p0 >> 32), lo0 = (uint32_t)p0;
+		uint32_t hi1 = (uint32_t)(p1 >> 32), lo1 = (uint32_t)p1;
+		c[0] = hi1 ^ c[1] ^ k[0];
+		c[1] = lo1;
+		c[2] = hi0 ^ c[3] ^ k[1];
+		c[3] = lo0;
+	}
+
+	void siguienteBloque(){
+		uint32_t c[4] = { contador[0], contador[1], contador[2], contador[3] };
+		uint32_t k[2] = { clave[0], clave[1] };
+		for (int i = 0; i < 10; ++i){
+			if (i > 0){
+				k[0] += 0x9E3779B9u;
+				k[1] += 0xBB67AE85u;
+			}
+			ronda(c, k);
+		}
+		for (int i = 0; i < 4; ++i){
+			bloque[i] = c[i];
+		}
+		// El contador es un entero de 128 bits
+		for (int i = 0; i < 4 && ++contador[i] == 0; ++i);
+		usados = 0;
+	}
+
+public:
+	Philox4x32(uint32_t seed = 0){
+		uint64_t semilla = seed;
+		uint64_t k = splitMix64(semilla);
+		clave[0] = (uint32_t)k;
+		clave[1] = (uint32_t)(k >> 32);
+		contador[0] = contador[1] = contador[2] = contador[3] = 0;
+		usados = 4;
+	}
+
+	uint32_t next(){
+		if (usados == 4) siguienteBloque();
+		return bloque[usados++];
+	}
+
+	float nextFloat(){
+		return bitsToFloat(next());
+	}
+
+	void fill(float *dst, int n){
+		int i = 0;
+		while (i < n && usados < 4){
+			dst[i++] = bitsToFloat(bloque[usados++]);
+		}
+		while (i + 4 <= n){
+			siguienteBloque();
+			for (int j = 0; j < 4; ++j){
+				dst[i++] = bitsToFloat(bloque[j]);
+			}
+			usados = 4;
+		}
+		while (i < n){
+			dst[i++] = nextFloat();
+		}
+	}
+};
+
+/**
+* El srand()/rand() global de la biblioteca de C, tal y como se usaba antes. Solo tiene sentido para reproducir mapas
+* generados con versiones antiguas: comparte el estado con todo el proceso, asi que NO aisla un mapa de otro
+*/
+class RandGlobal {
+public:
+	/**
+	* Sin semilla no toca el estado global: los mapas crean su generador sin semilla antes de sembrarlo, y no deben
+	* reiniciar la secuencia de rand() de nadie hasta que no se les da una
+	*/
+	RandGlobal(){
+	}
+
+	RandGlobal(uint32_t seed){
+		srand(seed);
+	}
+
+	uint32_t next(){
+		return (uint32_t)rand();
+	}
+
+	float nextFloat(){
+		return ((float)rand() / (RAND_MAX));
+	}
+
+	void fill(float *dst, int n){
+		for (int i = 0; i < n; ++i){
+			dst[i] = nextFloat();
+		}
+	}
+};
+
+/**
+* Indica si un generador tiene su propio estado, y por tanto se pueden usar varios a la vez desde hilos distintos sin
+* que se pisen. Todos lo tienen salvo RandGlobal
+*/
+template <class Rng>
+struct EstadoPropio {
+	static const bool valor = true;
+};
+
+template <>
+struct EstadoPropio<RandGlobal> {
+	static const bool valor = false;
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+* Tipos de muestra con los que se pueden guardar las alturas de un mapa (BasicMap<Sample>):
+*	float		32 bits, sin perdida (por defecto)
+*	Half		16 bits, float IEEE de media precision (11 bits de mantisa)
+*	uint16_t	16 bits, punto fijo: 65536 niveles repartidos entre un minimo y un maximo que se fijan antes de generar
+*
+* Las cuentas de la generacion se hacen siempre en float: cada altura se lee descuantizada y se cuantiza al guardarla.
+* Cuantizacion<Sample> es el que pasa de un formato a otro, y todas siguen la misma forma:
+*	Sample codifica(float v)			float -> muestra (redondeando al valor representable mas cercano)
+*	float decodifica(Sample s)			muestra -> float
+*	void ajusta(float minimo, float maximo)		fija el rango de alturas que se van a guardar
+*	void restaura(float base, float paso)		recupera una cuantizacion guardada (ver getBase() y getPaso())
+*/
+
+/**
+* Tipo de muestra, tal y como se guarda en la cabecera de un fichero de alturas (ver HeightFile.hpp)
+*/
+enum TipoMuestra {
+	MUESTRA_FLOAT = 0,
+	MUESTRA_HALF = 1,
+	MUESTRA_FIJO16 = 2
+};
+
+/**
+* Bytes que ocupa cada muestra de un tipo dado (0 si el tipo no es valido)
+*/
+inline size_t bytesMuestra(uint32_t tipo){
+	switch (tipo){
+	case MUESTRA_FLOAT: return 4;
+	case MUESTRA_HALF: return 2;
+	case MUESTRA_FIJO16: return 2;
+	default: return 0;
+	}
+}
+
+/**
+* Float de media precision (IEEE 754 binary16). Solo guarda los bits, las cuentas se hacen en float
+*/
+struct Half {
+	uint16_t bits;
+};
+
+/**
+* Pasa un float a half redondeando al par mas cercano. Los valores que no caben (mas de 65504 en valor absoluto) se
+* quedan en el maximo representable, no en infinito, para que una altura desbordada siga siendo una altura
+*/
+inline uint16_t floatToHalf(float f){
+	uint32_t x;
+	memcpy(&x, &f, 4);
+	uint32_t signo = (x >> 16) & 0x8000;
+	uint32_t abs = x & 0x7FFFFFFF;
+	if (abs >= 0x477FF000) return (uint16_t)(signo | 0x7BFF);		// >= 65520 (o infinito/NaN): satura
+	if (abs >= 0x38800000){
+		// Normal: se cambia el sesgo del exponente (127 -> 15) y se redondean los 13 bits de mantisa que sobran
+		return (uint16_t)(signo | ((abs + 0xC8000FFF + ((abs >> 13) & 1)) >> 13));
+	}
+	// Subnormal: sumando 0.5 el propio float redondea a multiplos de 2^-24, que es el paso de los subnormales
+	float t;
+	memcpy(&t, &abs, 4);
+	t += 0.5f;
+	uint32_t m;
+	memcpy(&m, &t, 4);
+	return (uint16_t)(signo | (m - 0x3F000000));
+}
+
+/**
+* Pasa un half a float (sin perdida)
+*/
+inline float halfToFloat(uint16_t h){
+	uint32_t signo = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponente = (h >> 10) & 0x1F;
+	uint32_t mantisa = h & 0x3FF;
+	uint32_t x;
+	if (exponente == 0){
+		float f = mantisa * (1.0f / 16777216.0f);	// subnormal (o cero): mantisa * 2^-24
+		memcpy(&x, &f, 4);
+		x |= signo;
+	}
+	else if (exponente == 31){
+		x = signo | 0x7F800000 | (mantisa << 13);
+	}
+	else {
+		x = signo | ((exponente + 112) << 23) | (mantisa << 13);
+	}
+	float f;
+	memcpy(&f, &x, 4);
+	return f;
+}
+
+template <class Sample>
+class Cuantizacion;
+
+/**
+* float: no hay cuantizacion, las alturas se guardan tal cual
+*/
+template <>
+class Cuantizacion<float> {
+public:
+	static const uint32_t tipo = MUESTRA_FLOAT;
+
+	float codifica(float v) const {
+		return v;
+	}
+
+	float decodifica(float s) const {
+		return s;
+	}
+
+	void ajusta(float, float){
+	}
+
+	/**
+	* Sin rango: cualquier altura se puede guardar
+	*/
+	bool cubre(float, float) const {
+		return true;
+	}
+
+	void restaura(float, float){
+	}
+
+	float getBase() const {
+		return 0;
+	}
+
+	float getPaso() const {
+		return 0;
+	}
+};
+
+/**
+* Half: el exponente hace que la precision sea relativa (unas 3 cifras), asi que no hace falta conocer el rango.
+* Por encima de 16384 el paso ya es de 16 unidades, y a partir de 65504 satura: sirve hasta detalle 14 con roughness <= 1
+*/
+template <>
+class Cuantizacion<Half> {
+public:
+	static const uint32_t tipo = MUESTRA_HALF;
+
+	Half codifica(float v) const {
+		Half h;
+		h.bits = floatToHalf(v);
+		return h;
+	}
+
+	float decodifica(Half s) const {
+		return halfToFloat(s.bits);
+	}
+
+	void ajusta(float, float){
+	}
+
+	/**
+	* Sin rango: cualquier altura se puede guardar
+	*/
+	bool cubre(float, float) const {
+		return true;
+	}
+
+	void restaura(float, float){
+	}
+
+	float getBase() const {
+		return 0;
+	}
+
+	float getPaso() const {
+		return 0;
+	}
+};
+
+/**
+* Punto fijo de 16 bits: la muestra q representa la altura base + q*paso. El rango se fija con ajusta() antes de generar;
+* lo que se salga de el se queda en el extremo (el mapa lo amplia antes de cada edicion que se pueda salir, ver
+* BasicMap::cuantizacionPara())
+*/
+template <>
+class Cuantizacion<uint16_t> {
+private:
+	float base;
+	float paso;
+	float inverso;	// 1/paso
+
+public:
+	static const uint32_t tipo = MUESTRA_FIJO16;
+
+	Cuantizacion(){
+		restaura(0, 1);
+	}
+
+	uint16_t codifica(float v) const {
+		float q = (v - base) * inverso + 0.5f;
+		if (q <= 0) return 0;
+		if (q >= 65535) return 65535;
+		return (uint16_t)q;
+	}
+
+	float decodifica(uint16_t s) const {
+		return base + s * paso;
+	}
+
+	void ajusta(float minimo, float maximo){
+		restaura(minimo, (maximo - minimo) / 65535);
+	}
+
+	/**
+	* True si las alturas de minimo a maximo caben en el rango sin quedarse en el extremo
+	*/
+	bool cubre(float minimo, float maximo) const {
+		return minimo >= base && maximo <= base + 65535 * paso;
+	}
+
+	void restaura(float base, float paso){
+		this->base = base;
+		this->paso = (paso > 0) ? paso : 1;
+		this->inverso = 1 / this->paso;
+	}
+
+	float getBase() const {
+		return base;
+	}
+
+	float getPaso() const {
+		return paso;
+	}
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+/*
+* Instrumentacion de la generacion y la representacion de los mapas. Solo existe si se compila con MAPGEN_STATS
+* definido; si no, MAPGEN_STAT(...) no deja nada y el codigo instrumentado queda exactamente igual que sin instrumentar.
+*
+* Con MAPGEN_STATS, cada mapa guarda (ver Map::getEstadisticas()):
+*	- por cada nivel de la ultima generacion: tiempo, casillas calculadas y casillas del borde (que van por
+*	  diamondBorde()) de sus square y sus diamond
+*	- el tiempo de la busqueda de higher y lower
+*	- el tiempo y los pixeles escritos de cada representacion
+* y lo puede volcar como trazas en formato "trace event" (chrome://tracing, Perfetto) con guardaTraza().
+*/
+
+#ifdef MAPGEN_STATS
+#define MAPGEN_STAT(...) __VA_ARGS__
+#else
+#define MAPGEN_STAT(...)
+#endif
+
+#ifdef MAPGEN_STATS
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+
+/**
+* Reloj monotono, en nanosegundos
+*/
+inline long long relojNs(){
+	return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+* Lo medido en un nivel (lado) de la generacion.
+* Los tiempos de square y diamond son la suma de lo que ha pasado cada hilo en ellos, asi que con varios hilos pueden
+* sumar mas que el tiempo del nivel (que es tiempo de reloj). Su cociente es lo que se aprovechan los hilos
+*/
+struct EstadisticasNivel {
+	int lado;
+	long long inicioNs;			// relojNs() al empezar el nivel
+	long long ns;				// tiempo de reloj del nivel entero
+	long long nsSquare;
+	long long nsDiamond;
+	long long casillasSquare;
+	long long casillasDiamond;
+	long long bordes;			// casillas diamond del borde del mapa (las que pasan por diamondBorde())
+};
+
+/**
+* Lo medido en una llamada a un representador
+*/
+struct EstadisticasRepresentacion {
+	const char *vista;			// nombre del metodo (mostrarVistaPlanta, mostrarCorte3DLR, ...)
+	long long inicioNs;
+	long long ns;
+	long long pixeles;			// pixeles escritos en el lienzo
+};
+
+/**
+* Estadisticas de un mapa
+*/
+struct Estadisticas {
+	long long inicioNs;			// relojNs() al empezar la ultima generacion
+	long long nsGeneracion;		// tiempo total de la ultima generacion
+	long long nsLimites;		// tiempo buscando higher y lower (dentro del ultimo nivel, o recorriendo el mapa)
+	std::vector<EstadisticasNivel> niveles;					// del primer nivel (lado max) al ultimo (lado 2)
+	std::vector<EstadisticasRepresentacion> representaciones;	// todas desde la ultima llamada a limpia()
+
+	Estadisticas(){
+		limpia();
+	}
+
+	void limpia(){
+		inicioNs = 0;
+		nsGeneracion = 0;
+		nsLimites = 0;
+		niveles.clear();
+		representaciones.clear();
+	}
+
+	/**
+	* Escribe las estadisticas como un JSON de trace events (formato de chrome://tracing), con un evento por la
+	* generacion, uno por nivel y uno por representacion. Devuelve false si no se ha podido escribir
+	*/
+	bool guardaTraza(const char *ruta) const {
+		FILE *f = fopen(ruta, "w");
+		if (f == NULL) return false;
+		fprintf(f, "{\"traceEvents\": [");
+		bool primero = true;
+		if (nsGeneracion > 0){
+			fprintf(f, "\n{\"name\": \"generate\", \"cat\": \"generate\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, "
+				"\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"limites_us\": %.3f}}",
+				inicioNs / 1000.0, nsGeneracion / 1000.0, nsLimites / 1000.0);
+			primero = false;
+		}
+		for (size_t i = 0; i < niveles.size(); ++i){
+			const EstadisticasNivel &n = niveles[i];
+			fprintf(f, "%s\n{\"name\": \"lado %d\", \"cat\": \"nivel\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, "
+				"\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"square_us\": %.3f, \"diamond_us\": %.3f, "
+				"\"casillas_square\": %lld, \"casillas_diamond\": %lld, \"bordes\": %lld}}",
+				primero ? "" : ",", n.lado, n.inicioNs / 1000.0, n.ns / 1000.0, n.nsSquare / 1000.0,
+				n.nsDiamond / 1000.0, n.casillasSquare, n.casillasDiamond, n.bordes);
+			primero = false;
+		}
+		for (size_t i = 0; i < representaciones.size(); ++i){
+			const EstadisticasRepresentacion &r = representaciones[i];
+			fprintf(f, "%s\n{\"name\": \"%s\", \"cat\": \"render\", \"ph\": \"X\", \"pid\": 1, \"tid\": 2, "
+				"\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"pixeles\": %lld}}",
+				primero ? "" : ",", r.vista, r.inicioNs / 1000.0, r.ns / 1000.0, r.pixeles);
+			primero = false;
+		}
+		fprintf(f, "\n]}\n");
+		return fclose(f) == 0;
+	}
+};
+
+/**
+* Contadores de un nivel mientras se esta calculando. Son atomicos porque los actualizan todos los hilos del nivel
+* (una vez por fila, no por casilla)
+*/
+struct ContadoresNivel {
+	std::atomic<long long> nsSquare;
+	std::atomic<long long> nsDiamond;
+	std::atomic<long long> nsLimites;
+	std::atomic<long long> casillasSquare;
+	std::atomic<long long> casillasDiamond;
+	std::atomic<long long> bordes;
+
+	ContadoresNivel() : nsSquare(0), nsDiamond(0), nsLimites(0), casillasSquare(0), casillasDiamond(0), bordes(0){
+	}
+};
+
+#endif
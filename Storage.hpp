@@ -0,0 +1,164 @@
+#pragma once
+
+#include <new>
+#include <memory>
+#include <utility>
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+/*
+* Memoria de la matriz de alturas de un mapa (ver BasicMap<Sample, Rng, Alloc>).
+* Alloc es un asignador con la forma de los de la STL (value_type, allocate(n) y deallocate(p, n)), asi que un mapa se
+* puede montar sobre una arena, paginas grandes o memoria compartida solo con pasarle el asignador. Por defecto es
+* AsignadorAlineado, que deja la matriz alineada a 64 bytes (una linea de cache, y lo que piden las cargas alineadas de
+* AVX-512) para que los kernels puedan empezar cada recorrido en una direccion alineada.
+*/
+
+/**
+* Asignador que devuelve memoria alineada a Alineacion bytes (potencia de 2, como minimo sizeof(void*)).
+* No tiene estado: dos asignadores del mismo tipo son intercambiables
+*/
+template <class T, size_t Alineacion = 64>
+class AsignadorAlineado {
+public:
+	typedef T value_type;
+
+	template <class U>
+	struct rebind {
+		typedef AsignadorAlineado<U, Alineacion> other;
+	};
+
+	AsignadorAlineado(){
+	}
+
+	template <class U>
+	AsignadorAlineado(const AsignadorAlineado<U, Alineacion>&){
+	}
+
+	/**
+	* Reserva n elementos sin construir. Si no hay memoria lanza std::bad_alloc, igual que new[]
+	*/
+	T* allocate(size_t n){
+		if (n > (size_t)-1 / sizeof(T)) throw std::bad_alloc();
+		size_t bytes = (n > 0) ? n * sizeof(T) : 1;
+		void *p;
+#ifdef _WIN32
+		p = _aligned_malloc(bytes, Alineacion);
+		if (p == NULL) throw std::bad_alloc();
+#else
+		if (posix_memalign(&p, Alineacion, bytes) != 0) throw std::bad_alloc();
+#endif
+		return (T*)p;
+	}
+
+	void deallocate(T *p, size_t){
+#ifdef _WIN32
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+};
+
+template <class T, class U, size_t Alineacion>
+bool operator==(const AsignadorAlineado<T, Alineacion>&, const AsignadorAlineado<U, Alineacion>&){
+	return true;
+}
+
+template <class T, class U, size_t Alineacion>
+bool operator!=(const AsignadorAlineado<T, Alineacion>&, const AsignadorAlineado<U, Alineacion>&){
+	return false;
+}
+
+/**
+* La matriz de alturas de un mapa. Se usa como el puntero a la matriz (se convierte sola a T*, y se le puede asignar un
+* T* o sumar un desplazamiento), pero ademas sabe si la memoria es suya:
+*	- reserva(n) reserva n elementos con el asignador; son suyos, y se liberan al destruirla o al reservar otros
+*	- asignarle un puntero solo cambia a donde apunta: la memoria ajena (un HeightFile, la matriz de otro mapa) nunca
+*	  se libera, y la propia se sigue liberando aunque mientras tanto apunte a otro sitio (ver BasicMap::VistaSector)
+* No se puede copiar (la memoria se liberaria dos veces). Al moverla, la memoria pasa a la nueva y la vieja queda vacia
+*/
+template <class T, class Alloc>
+class AlmacenAlturas {
+private:
+	typedef std::allocator_traits<Alloc> Rasgos;
+
+	T *datos;		// a donde apunta (lo que ve el mapa)
+	T *propios;		// memoria reservada por el almacen (NULL si no tiene)
+	size_t n;		// elementos de propios
+	Alloc alloc;
+
+	void libera(){
+		if (propios != NULL) Rasgos::deallocate(alloc, propios, n);
+		propios = NULL;
+		n = 0;
+	}
+
+public:
+	explicit AlmacenAlturas(const Alloc &alloc = Alloc()) : datos(NULL), propios(NULL), n(0), alloc(alloc){
+	}
+
+	~AlmacenAlturas(){
+		libera();
+	}
+
+	AlmacenAlturas(const AlmacenAlturas&) = delete;
+	AlmacenAlturas& operator=(const AlmacenAlturas&) = delete;
+
+	AlmacenAlturas(AlmacenAlturas &&otro) : datos(otro.datos), propios(otro.propios), n(otro.n),
+		alloc(std::move(otro.alloc)){
+		otro.datos = NULL;
+		otro.propios = NULL;
+		otro.n = 0;
+	}
+
+	AlmacenAlturas& operator=(AlmacenAlturas &&otro){
+		if (this != &otro){
+			libera();
+			datos = otro.datos;
+			propios = otro.propios;
+			n = otro.n;
+			alloc = std::move(otro.alloc);
+			otro.datos = NULL;
+			otro.propios = NULL;
+			otro.n = 0;
+		}
+		return *this;
+	}
+
+	/**
+	* Reserva (con el asignador) n elementos propios, sin inicializar, y pasa a apuntar a ellos. Libera los anteriores
+	*/
+	void reserva(size_t n){
+		libera();
+		propios = Rasgos::allocate(alloc, n);
+		this->n = n;
+		datos = propios;
+	}
+
+	/**
+	* Pasa a apuntar a otro sitio, sin reservar ni liberar nada
+	*/
+	AlmacenAlturas& operator=(T *ajenos){
+		datos = ajenos;
+		return *this;
+	}
+
+	operator T*() const {
+		return datos;
+	}
+
+	/**
+	* True si la memoria es del almacen (y no de un fichero u otro mapa)
+	*/
+	bool esPropia() const {
+		return propios != NULL;
+	}
+
+	const Alloc& getAsignador() const {
+		return alloc;
+	}
+};
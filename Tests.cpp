@@ -0,0 +1,92 @@
+/*
+* Pruebas de MapGen2: cada prueba comprueba un caso concreto y dice si ha fallado. Acaba con 0 si han ido todas bien.
+* No necesita ventana ni ficheros.
+*
+*	Tests
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "Map.hpp"
+
+static int fallos = 0;
+
+static void comprueba(bool bien, const char *prueba){
+	printf("%s %s\n", bien ? "ok   " : "FALLO", prueba);
+	if (!bien) ++fallos;
+}
+
+/**
+* Diferencia maxima entre las alturas de dos mapas del mismo tamano
+*/
+template <class A, class B>
+static float diferenciaMaxima(const A &a, const B &b){
+	size_t n = (size_t)a.getSize() * a.getSize();
+	float peor = 0;
+	for (size_t i = 0; i < n; ++i){
+		float d = fabsf(a.getCuantizacion().decodifica(a.getHeights()[i]) - b.getCuantizacion().decodifica(b.getHeights()[i]));
+		if (d > peor) peor = d;
+	}
+	return peor;
+}
+
+/**
+* Un Map16 editado con una altura central fuera del rango con el que se genero tiene que quedar como el mismo mapa en
+* float (salvo la precision de la cuantizacion), y no aplanado en el extremo del rango
+*/
+static void edicionFueraDeRango(){
+	for (int caso = 0; caso < 4; ++caso){
+		// generate(0) deja el rango mas pequeno posible (+-1 alrededor de la altura de las esquinas)
+		float roughness = (caso & 1) ? 0.0f : 0.3f;
+		Map16 q(7, 11);
+		Map f(7, 11);
+		q.generate(roughness);
+		f.generate(roughness);
+		float central = (caso & 2) ? -300.0f : 600.0f;
+		if (caso < 2){
+			q.modificaSector(32, 32, 5, 0.5f, central);
+			f.modificaSector(32, 32, 5, 0.5f, central);
+		}
+		else {
+			std::vector<EdicionSector> ediciones;
+			for (int k = 0; k < 4; ++k){
+				EdicionSector e = { 16 * k, 8 * k, 4, 0.8f, central + 37 * k };
+				ediciones.push_back(e);
+			}
+			q.modificaSectores(ediciones, 3);
+			f.modificaSectores(ediciones, 3);
+		}
+		char prueba[128];
+		sprintf(prueba, "edicion fuera de rango de Map16 (roughness %g, %s)", roughness,
+			(caso < 2) ? "modificaSector" : "modificaSectores");
+		comprueba(diferenciaMaxima(q, f) < 0.5f, prueba);
+	}
+}
+
+/**
+* Lo mismo con generateSector(), que regenera todo el mapa salvo las esquinas: la cuantizacion de Map16 se rehace para
+* el nuevo roughness, sin perder las esquinas ni quedarse corta para la altura central
+*/
+static void sectorFueraDeRango(){
+	for (int caso = 0; caso < 4; ++caso){
+		float roughness = (caso & 1) ? 0.0f : 0.3f;
+		int central = (caso & 2) ? -300 : 600;
+		Map16 q(7, 11);
+		Map f(7, 11);
+		q.generate(0.6f);
+		f.generate(0.6f);
+		q.generateSector(roughness, central);
+		f.generateSector(roughness, central);
+		char prueba[128];
+		sprintf(prueba, "generateSector fuera de rango de Map16 (roughness %g, centro %d)", roughness, central);
+		comprueba(diferenciaMaxima(q, f) < 0.5f, prueba);
+	}
+}
+
+int main(){
+	edicionFueraDeRango();
+	sectorFueraDeRango();
+	printf("%d fallos\n", fallos);
+	return (fallos == 0) ? 0 : 1;
+}
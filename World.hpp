@@ -0,0 +1,153 @@
+#pragma once
+
+#include <list>
+#include <vector>
+#include <stdint.h>
+#include <unordered_map>
+#include "Map.hpp"
+
+/**
+* Mundo "infinito" hecho de tiles de Diamond-Square que se generan bajo demanda.
+* Cada tile es un mapa de (2^detalle)+1 casillas de lado, y comparte su fila/columna de borde con el vecino, de modo que
+* el mundo no tiene costuras (ver Map::generateTile()). La casilla global (gx, gy) cae en el tile
+* (gx / (size-1), gy / (size-1)).
+*
+* Los tiles generados se guardan en una cache LRU de como mucho maxTiles tiles; cuando se llena, se descarta el que
+* lleva mas tiempo sin usarse. Como cada tile se genera solo a partir de la semilla del mundo y de su posicion,
+* uno descartado se puede volver a generar cuando se necesite y sale exactamente igual.
+*/
+class World {
+private:
+
+	struct Tile {
+		int tileX;
+		int tileY;
+		std::vector<float> alturas;
+	};
+
+	/*
+	* Tiles en cache, del usado mas recientemente (delante) al que mas tiempo lleva sin usarse (detras)
+	*/
+	std::list<Tile> tiles;
+
+	/*
+	* Indice de la cache: clave del tile (ver clave()) -> posicion en la lista
+	*/
+	std::unordered_map<uint64_t, std::list<Tile>::iterator> indice;
+
+	uint32_t seed;
+	float roughness;
+	size_t maxTiles;
+	int threads;
+	int detail;
+	int size;
+
+	/*
+	* Tiles generados desde que se creo el mundo (incluidos los que se han vuelto a generar tras descartarse)
+	*/
+	long long generados;
+
+	static uint64_t clave(int tileX, int tileY){
+		return ((uint64_t)(uint32_t)tileX << 32) | (uint32_t)tileY;
+	}
+
+	/**
+	* Division entera redondeando hacia abajo (tambien para negativos)
+	*/
+	static long long divAbajo(long long a, long long b){
+		long long q = a / b;
+		return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+	}
+
+public:
+
+	/**
+	* Crea un mundo con tiles de nivel de detalle 'detail'. Ningun tile se genera hasta que se pide.
+	* threads es el numero de hilos con el que se genera cada tile (<= 0 para usar todos los nucleos)
+	*/
+	World(int detail, int seed, float roughness, size_t maxTiles, int threads = 1){
+		this->seed = (uint32_t)seed;
+		this->roughness = roughness;
+		this->maxTiles = (maxTiles < 1) ? 1 : maxTiles;
+		this->threads = threads;
+		this->detail = detail;
+		this->size = (1 << detail) + 1;
+		this->generados = 0;
+	}
+
+	/**
+	* Devuelve las alturas del tile (tileX, tileY) (size x size, la casilla (x,y) esta en x + size*y), generandolo si
+	* no estaba en la cache.
+	* El puntero es valido hasta que el tile salga de la cache, es decir, como minimo hasta la proxima llamada a tile()
+	* o a height() que tenga que generar un tile nuevo.
+	*/
+	const float* tile(int tileX, int tileY){
+		uint64_t k = clave(tileX, tileY);
+		std::unordered_map<uint64_t, std::list<Tile>::iterator>::iterator it = indice.find(k);
+		if (it != indice.end()){
+			tiles.splice(tiles.begin(), tiles, it->second);	// pasa a ser el mas reciente
+			return &tiles.front().alturas[0];
+		}
+
+		// Si la cache esta llena, el tile menos usado deja sitio (y su memoria) al nuevo
+		std::vector<float> alturas;
+		if (tiles.size() >= maxTiles){
+			indice.erase(clave(tiles.back().tileX, tiles.back().tileY));
+			alturas.swap(tiles.back().alturas);
+			tiles.pop_back();
+		}
+		alturas.resize((size_t)size * size);
+		// El tile se genera directamente sobre su matriz de la cache (ver BasicMapBatch en Batch.hpp)
+		Map mapa(detail, (int)seed, &alturas[0]);
+		mapa.setRenderSink(NULL);
+		mapa.generateTile(roughness, seed, tileX, tileY, threads);
+		++generados;
+
+		tiles.push_front(Tile());
+		tiles.front().tileX = tileX;
+		tiles.front().tileY = tileY;
+		tiles.front().alturas.swap(alturas);
+		indice[k] = tiles.begin();
+		return &tiles.front().alturas[0];
+	}
+
+	/**
+	* Devuelve la altura de la casilla global (gx, gy), generando su tile si hace falta
+	*/
+	float height(long long gx, long long gy){
+		long long lado = size - 1;
+		long long tx = divAbajo(gx, lado);
+		long long ty = divAbajo(gy, lado);
+		const float *alturas = tile((int)tx, (int)ty);
+		return alturas[(gx - tx * lado) + size * (gy - ty * lado)];
+	}
+
+	/**
+	* Lado de cada tile, en casillas (incluye el borde compartido con el vecino)
+	*/
+	int getTileSize() const {
+		return size;
+	}
+
+	/**
+	* Numero de tiles que hay ahora mismo en la cache
+	*/
+	size_t getCachedTiles() const {
+		return tiles.size();
+	}
+
+	/**
+	* Numero de tiles generados desde que se creo el mundo
+	*/
+	long long getGeneratedTiles() const {
+		return generados;
+	}
+
+	/**
+	* Vacia la cache
+	*/
+	void clear(){
+		tiles.clear();
+		indice.clear();
+	}
+};